@@ -1,9 +1,15 @@
 #include "devices/block.h"
 #include <list.h>
+#include <round.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* A block device. */
 struct block
@@ -19,6 +25,34 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    struct list queue;                  /* Pending requests, for drivers
+                                           that queue them. */
+    block_sector_t head;                /* Sector after the last request
+                                           dequeued. */
+
+    struct block_stats stats;           /* Requests submitted here. */
+    uint64_t created;                   /* Time-stamp counter at
+                                           registration. */
+    uint64_t busy_start;                /* Time-stamp counter when the
+                                           queue last became nonempty. */
+    int64_t created_ticks;              /* Timer ticks at registration. */
+
+    /* Fair sharing, for devices requests are accounted to. */
+    uint64_t vtime;                     /* Weighted sectors dispatched. */
+    unsigned queued;                    /* Requests in a disk queue. */
+
+    /* Fair sharing, for devices that queue requests. */
+    uint64_t vclock;                    /* VTIME of the latest source
+                                           dispatched from. */
+
+    /* Write combining. */
+    struct lock wc_lock;                /* Protects the members below. */
+    uint8_t *wc_data;                   /* Held sectors, allocated on
+                                           first use. */
+    block_sector_t wc_start;            /* First held sector. */
+    size_t wc_cnt;                      /* Number held, 0 if none. */
+    int64_t wc_deadline;                /* Timer tick to write them by. */
   };
 
 /* List of all block devices. */
@@ -28,6 +62,10 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer_sync (struct block *, struct block_request *);
+static void account_submit (struct block *, struct block_request *);
+static void account_done (struct block_request *);
+static void combine_check (struct block *, struct block_request *);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +151,67 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Most pages of bounce buffer used for a transfer to or from
+   user memory. */
+#define BOUNCE_PAGES 16
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFER, to BLOCK if WRITE is true, and waits for the transfer
+   to complete. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          size_t cnt, void *buffer)
+{
+  struct block_request req;
+  uint8_t *user = buffer;
+  uint8_t *bounce;
+  size_t page_cnt, max_cnt;
+
+  if (cnt == 0)
+    return;
+  if (is_kernel_vaddr (buffer))
+    {
+      block_request_init (&req, write, sector, cnt, buffer, NULL, NULL);
+      block_submit (block, &req);
+      block_wait (&req);
+      return;
+    }
+
+  /* Drivers may move the data from an interrupt handler, when
+     another process's page directory may be active, so a user
+     buffer goes through kernel pages, copied here in the caller's
+     context. */
+  page_cnt = DIV_ROUND_UP (cnt * BLOCK_SECTOR_SIZE, PGSIZE);
+  if (page_cnt > BOUNCE_PAGES)
+    page_cnt = BOUNCE_PAGES;
+  bounce = palloc_get_multiple (0, page_cnt);
+  if (bounce == NULL)
+    {
+      page_cnt = 1;
+      bounce = palloc_get_page (PAL_ASSERT);
+    }
+  max_cnt = page_cnt * PGSIZE / BLOCK_SECTOR_SIZE;
+
+  while (cnt > 0)
+    {
+      size_t chunk = cnt < max_cnt ? cnt : max_cnt;
+      size_t size = chunk * BLOCK_SECTOR_SIZE;
+
+      if (write)
+        memcpy (bounce, user, size);
+      block_request_init (&req, write, sector, chunk, bounce, NULL, NULL);
+      block_submit (block, &req);
+      block_wait (&req);
+      if (!write)
+        memcpy (user, bounce, size);
+
+      user += size;
+      sector += chunk;
+      cnt -= chunk;
+    }
+  palloc_free_multiple (bounce, page_cnt);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +219,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer (block, false, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +230,618 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  transfer (block, true, sector, 1, (void *) buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it transfer the whole run with a
+   single command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  transfer (block, false, sector, cnt, buffer);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  transfer (block, true, sector, cnt, (void *) buffer);
+}
+
+/* Initializes REQ to transfer CNT sectors starting at SECTOR
+   between a block device and BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes: to the device if WRITE is
+   true, from it otherwise.
+
+   If DONE is non-null, it is called with REQ and AUX when the
+   transfer completes.  It may be called from an interrupt
+   handler, so it must not sleep.  Otherwise, block_wait() waits
+   for completion. */
+void
+block_request_init (struct block_request *req, bool write,
+                    block_sector_t sector, size_t cnt, void *buffer,
+                    block_request_func *done, void *aux)
+{
+  ASSERT (cnt > 0);
+
+  req->write = write;
+  req->sector = sector;
+  req->cnt = cnt;
+  req->buffer = buffer;
+  req->done = done;
+  req->aux = aux;
+  req->dev_sector = sector;
+  req->chain = NULL;
+  req->deadline = 0;
+  req->acct = NULL;
+  sema_init (&req->sema, 0);
+}
+
+/* Submits REQ, initialized with block_request_init(), to BLOCK.
+   Drivers that support it queue the request and return at once;
+   otherwise it is carried out before returning.  REQ and its
+   buffer, which must be in kernel memory, must stay in place
+   until it completes.
+
+   A driver that stacks on another device, such as a partition,
+   translates REQ->dev_sector and submits REQ to that device. */
+void
+block_submit (struct block *block, struct block_request *req)
+{
+  ASSERT (is_kernel_vaddr (req->buffer));
+  check_sector (block, req->dev_sector);
+  check_sector (block, req->dev_sector + req->cnt - 1);
+  if (req->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += req->cnt;
+    }
+  else
+    block->read_cnt += req->cnt;
+
+  /* Latency is accounted to the device the request was first
+     submitted to, such as a partition rather than its disk. */
+  if (req->acct == NULL)
+    account_submit (block, req);
+  combine_check (block, req);
+
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, req);
+  else
+    {
+      transfer_sync (block, req);
+      block_request_done (req);
+    }
+}
+
+/* Carries out REQ on BLOCK with its driver's synchronous
+   operations. */
+static void
+transfer_sync (struct block *block, struct block_request *req)
+{
+  const struct block_operations *ops = block->ops;
+  uint8_t *buffer = req->buffer;
+  size_t i;
+
+  if (req->write && ops->write_multiple != NULL)
+    ops->write_multiple (block->aux, req->dev_sector, req->cnt, buffer);
+  else if (!req->write && ops->read_multiple != NULL)
+    ops->read_multiple (block->aux, req->dev_sector, req->cnt, buffer);
+  else
+    for (i = 0; i < req->cnt; i++, buffer += BLOCK_SECTOR_SIZE)
+      {
+        if (req->write)
+          ops->write (block->aux, req->dev_sector + i, buffer);
+        else
+          ops->read (block->aux, req->dev_sector + i, buffer);
+      }
+}
+
+/* Waits for REQ, which must have been initialized without a
+   completion callback, to complete. */
+void
+block_wait (struct block_request *req)
+{
+  ASSERT (req->done == NULL);
+  sema_down (&req->sema);
+}
+
+/* Write combining.
+
+   block_write_combine() does not write to the device at once but
+   copies the data into a per-device buffer, where writes to
+   adjacent sectors that follow soon after, such as those of a
+   sorted cache flush or of consecutive swap slots, are combined
+   into a single transfer of up to WC_SECTORS sectors.  Held
+   sectors are written when a write that does not extend them
+   arrives, when the buffer fills, on block_flush(), and in any
+   case by a flusher thread within about twice WC_DELAY ticks.
+
+   Any other request for a held sector first waits for them to be
+   written, so reads always see the latest data and writes reach
+   the device in order. */
+
+/* Most sectors held per device. */
+#define WC_SECTORS 64
+
+/* Ticks to hold sectors for at most, roughly. */
+#define WC_DELAY (TIMER_FREQ / 20)
+
+static void combine_flush (struct block *);
+static void flusher (void *aux);
+
+/* Writes CNT sectors starting at SECTOR to BLOCK from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes, by way of
+   BLOCK's write-combining buffer.  Returns once the data has been
+   copied, possibly before it reaches the device.  Use
+   block_flush() to make sure it has. */
+void
+block_write_combine (struct block *block, block_sector_t sector,
+                     size_t cnt, const void *buffer)
+{
+  static bool flusher_started;
+  enum intr_level old_level;
+  bool start_flusher;
+
+  ASSERT (cnt > 0);
   check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  check_sector (block, sector + cnt - 1);
+
+  lock_acquire (&block->wc_lock);
+  if (block->wc_data == NULL)
+    block->wc_data = malloc (WC_SECTORS * BLOCK_SECTOR_SIZE);
+  if (block->wc_data == NULL || cnt > WC_SECTORS)
+    {
+      lock_release (&block->wc_lock);
+      block_write_multiple (block, sector, cnt, buffer);
+      return;
+    }
+
+  /* Start over unless the new sectors overlap or directly follow
+     the held ones and still fit. */
+  if (block->wc_cnt > 0
+      && (sector < block->wc_start
+          || sector > block->wc_start + block->wc_cnt
+          || sector + cnt > block->wc_start + WC_SECTORS))
+    combine_flush (block);
+  if (block->wc_cnt == 0)
+    {
+      block->wc_start = sector;
+      block->wc_deadline = timer_ticks () + WC_DELAY;
+    }
+  memcpy (block->wc_data + (sector - block->wc_start) * BLOCK_SECTOR_SIZE,
+          buffer, cnt * BLOCK_SECTOR_SIZE);
+  if (sector + cnt > block->wc_start + block->wc_cnt)
+    block->wc_cnt = sector + cnt - block->wc_start;
+  if (block->wc_cnt == WC_SECTORS)
+    combine_flush (block);
+  lock_release (&block->wc_lock);
+
+  old_level = intr_disable ();
+  start_flusher = !flusher_started;
+  flusher_started = true;
+  intr_set_level (old_level);
+  if (start_flusher
+      && thread_create ("block-flush", PRI_DEFAULT, flusher, NULL)
+         == TID_ERROR)
+    {
+      /* Without a flusher nothing would write the held sectors
+         out in time.  Write them now and retry on the next
+         call. */
+      flusher_started = false;
+      block_flush (block);
+    }
+}
+
+/* Writes any sectors held in BLOCK's write-combining buffer to
+   the device and waits for them to get there. */
+void
+block_flush (struct block *block)
+{
+  if (block->wc_cnt == 0)
+    return;
+  lock_acquire (&block->wc_lock);
+  combine_flush (block);
+  lock_release (&block->wc_lock);
+}
+
+/* Writes the sectors held for BLOCK, if any.  The caller must
+   hold BLOCK's write-combining lock. */
+static void
+combine_flush (struct block *block)
+{
+  ASSERT (lock_held_by_current_thread (&block->wc_lock));
+  if (block->wc_cnt > 0)
+    {
+      transfer (block, true, block->wc_start, block->wc_cnt, block->wc_data);
+      block->wc_cnt = 0;
+    }
+}
+
+/* Writes the sectors held for BLOCK first if REQ, just submitted
+   to it, covers any of them.  Requests submitted by
+   combine_flush() itself pass through. */
+static void
+combine_check (struct block *block, struct block_request *req)
+{
+  if (block->wc_cnt == 0
+      || req->dev_sector >= block->wc_start + block->wc_cnt
+      || req->dev_sector + req->cnt <= block->wc_start
+      || lock_held_by_current_thread (&block->wc_lock))
+    return;
+
+  ASSERT (!intr_context ());
+  block_flush (block);
+}
+
+/* Flusher thread.  Writes sectors that have been held past their
+   deadline. */
+static void
+flusher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct list_elem *e;
+
+      timer_sleep (WC_DELAY);
+      for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+           e = list_next (e))
+        {
+          struct block *block = list_entry (e, struct block, list_elem);
+          if (block->wc_cnt > 0 && timer_ticks () >= block->wc_deadline)
+            block_flush (block);
+        }
+    }
+}
+
+/* I/O scheduling.
+
+   A device's queue is ordered by the I/O scheduler, chosen with
+   -iosched on the kernel command line:
+
+     - "fifo" services requests in arrival order.
+
+     - "clook" is the C-LOOK elevator: it keeps the queue sorted
+       by sector and sweeps upward from the last sector serviced,
+       jumping back to the lowest request after the highest.
+
+     - "deadline", the default, is C-LOOK except that a request
+       that has waited past its deadline, READ_EXPIRE ticks for
+       reads and WRITE_EXPIRE for writes, goes first, so that a
+       long sweep cannot starve it.
+
+   Whichever request is chosen, queued requests in the same
+   direction for the sectors just before or after it are merged
+   with it into a single transfer of up to MERGE_MAX sectors.
+
+   Requests for one disk come from several sources, the devices
+   they were submitted to, such as its swap and file system
+   partitions, which share the disk by weighted fair queuing.  A
+   source's virtual time advances by FAIR_UNIT / weight for each
+   sector dispatched from it, and one that falls idle rejoins at
+   the current virtual time rather than banking credit.  If the
+   scheduler picks a request from a source more than FAIR_SLACK
+   ahead of the one furthest behind, the latter's first queued
+   request goes instead.  Weights default to 1 and are set per
+   role with -ioweight. */
+
+/* Deadlines, in timer ticks.  Reads usually have a thread waiting
+   for them, so they get the shorter one. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (TIMER_FREQ * 5)
+
+/* Most sectors merged into one transfer. */
+#define MERGE_MAX 256
+
+/* Virtual time charged per sector at weight 1, and how far a
+   source may run ahead of the rest.  The slack lets a source
+   keep a short sweep going before another gets its turn. */
+#define FAIR_UNIT 256
+#define FAIR_SLACK (FAIR_UNIT * 64)
+
+/* Largest weight. */
+#define FAIR_WEIGHT_MAX FAIR_UNIT
+
+/* Fair-share weight of each role's device. */
+static unsigned role_weights[BLOCK_ROLE_CNT] = {1, 1, 1, 1};
+
+/* An I/O scheduler. */
+struct block_scheduler
+  {
+    const char *name;
+
+    /* Adds REQ to BLOCK's queue. */
+    void (*add) (struct block *, struct block_request *);
+
+    /* Returns the request in BLOCK's nonempty queue to service
+       next, without removing it. */
+    struct block_request *(*pick) (struct block *);
+  };
+
+/* Returns true if request A_'s first sector precedes B_'s. */
+static bool
+sector_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->dev_sector < b->dev_sector;
+}
+
+/* Appends REQ to BLOCK's queue. */
+static void
+fifo_add (struct block *block, struct block_request *req)
+{
+  list_push_back (&block->queue, &req->elem);
+}
+
+/* Returns the oldest request in BLOCK's queue. */
+static struct block_request *
+fifo_pick (struct block *block)
+{
+  return list_entry (list_front (&block->queue), struct block_request, elem);
+}
+
+/* Inserts REQ into BLOCK's queue in sector order. */
+static void
+clook_add (struct block *block, struct block_request *req)
+{
+  list_insert_ordered (&block->queue, &req->elem, sector_less, NULL);
+}
+
+/* Returns the first request in BLOCK's queue at or after the
+   sector following the last one serviced, or the first request
+   if there is none. */
+static struct block_request *
+clook_pick (struct block *block)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *req = list_entry (e, struct block_request, elem);
+      if (req->dev_sector >= block->head)
+        return req;
+    }
+  return list_entry (list_front (&block->queue), struct block_request, elem);
+}
+
+/* Sets REQ's deadline and inserts it into BLOCK's queue in sector
+   order. */
+static void
+deadline_add (struct block *block, struct block_request *req)
+{
+  req->deadline = timer_ticks () + (req->write ? WRITE_EXPIRE : READ_EXPIRE);
+  clook_add (block, req);
+}
+
+/* Returns the request in BLOCK's queue whose deadline passed
+   first, if any has, or the request clook_pick() chooses. */
+static struct block_request *
+deadline_pick (struct block *block)
+{
+  int64_t now = timer_ticks ();
+  struct block_request *expired = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *req = list_entry (e, struct block_request, elem);
+      if (req->deadline <= now
+          && (expired == NULL || req->deadline < expired->deadline))
+        expired = req;
+    }
+  return expired != NULL ? expired : clook_pick (block);
+}
+
+/* Available I/O schedulers. */
+static const struct block_scheduler schedulers[] =
+  {
+    {"fifo", fifo_add, fifo_pick},
+    {"clook", clook_add, clook_pick},
+    {"deadline", deadline_add, deadline_pick},
+  };
+
+/* The I/O scheduler in use. */
+static const struct block_scheduler *scheduler = &schedulers[2];
+
+/* Makes the I/O scheduler called NAME the one in use.  Returns
+   true if successful, false if there is no such scheduler.  Must
+   be called before any request is queued. */
+bool
+block_set_scheduler (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+    if (!strcmp (name, schedulers[i].name))
+      {
+        scheduler = &schedulers[i];
+        return true;
+      }
+  return false;
+}
+
+/* Gives the device in ROLE, such as "swap", a fair share of a
+   disk it shares with other devices in proportion to WEIGHT, from
+   1 to FAIR_WEIGHT_MAX.  Returns true if successful, false if
+   ROLE or WEIGHT is invalid. */
+bool
+block_set_weight (const char *role, unsigned weight)
+{
+  int i;
+
+  if (weight < 1 || weight > FAIR_WEIGHT_MAX)
+    return false;
+  for (i = 0; i < BLOCK_ROLE_CNT; i++)
+    if (!strcmp (role, block_type_name (i)))
+      {
+        role_weights[i] = weight;
+        return true;
+      }
+  return false;
+}
+
+/* Returns the fair-share weight of BLOCK as a source. */
+static unsigned
+fair_weight (const struct block *block)
+{
+  int i;
+
+  for (i = 0; i < BLOCK_ROLE_CNT; i++)
+    if (block_by_role[i] == block)
+      return role_weights[i];
+  return 1;
+}
+
+/* Returns the request in BLOCK's queue to dispatch next: PICK,
+   chosen by the I/O scheduler, unless its source has run ahead of
+   another source's by more than FAIR_SLACK, in which case the
+   first queued request of the source furthest behind. */
+static struct block_request *
+fair_pick (struct block *block, struct block_request *pick)
+{
+  struct block_request *behind = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *req = list_entry (e, struct block_request, elem);
+      if (behind == NULL || req->acct->vtime < behind->acct->vtime)
+        behind = req;
+    }
+
+  if (pick->acct->vtime > behind->acct->vtime + FAIR_SLACK)
+    {
+      pick->acct->stats.throttled++;
+      return behind;
+    }
+  return pick;
+}
+
+/* Charges the source of REQ, dispatched from BLOCK's queue, for
+   its sectors. */
+static void
+fair_charge (struct block *block, struct block_request *req)
+{
+  struct block *src = req->acct;
+
+  if (src->vtime > block->vclock)
+    block->vclock = src->vtime;
+  src->vtime += (uint64_t) req->cnt * FAIR_UNIT / fair_weight (src);
+  src->queued--;
+}
+
+/* Removes and returns the request in BLOCK's queue for the same
+   direction as WRITE that starts at SECTOR, if FORWARD is true,
+   or ends just before it, if FORWARD is false.  Returns a null
+   pointer if there is none or it has more than MAX sectors. */
+static struct block_request *
+take_adjacent (struct block *block, bool write, block_sector_t sector,
+               bool forward, size_t max)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *req = list_entry (e, struct block_request, elem);
+      if (req->write == write && req->cnt <= max
+          && (forward
+              ? req->dev_sector == sector
+              : req->dev_sector + req->cnt == sector))
+        {
+          list_remove (e);
+          return req;
+        }
+    }
+  return NULL;
+}
+
+/* Adds REQ to BLOCK's queue of pending requests.  For drivers
+   that queue requests.  Interrupts must be off. */
+void
+block_enqueue (struct block *block, struct block_request *req)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* A source that was idle starts level with the others. */
+  if (req->acct->queued++ == 0 && req->acct->vtime < block->vclock)
+    req->acct->vtime = block->vclock;
+  scheduler->add (block, req);
+}
+
+/* Removes the request that BLOCK's I/O scheduler chooses to
+   service next from BLOCK's queue, together with the queued
+   requests it can be merged with, and returns the chain of them
+   in sector order.  Returns a null pointer if the queue is empty.
+   For drivers that queue requests.  Interrupts must be off. */
+struct block_request *
+block_dequeue (struct block *block)
+{
+  struct block_request *first, *last, *req;
+  size_t cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (list_empty (&block->queue))
+    return NULL;
+
+  first = last = fair_pick (block, scheduler->pick (block));
+  list_remove (&first->elem);
+  first->chain = NULL;
+  cnt = first->cnt;
+
+  /* Merge requests for the following sectors, then for the
+     preceding ones. */
+  while (cnt < MERGE_MAX
+         && (req = take_adjacent (block, first->write,
+                                  last->dev_sector + last->cnt, true,
+                                  MERGE_MAX - cnt)) != NULL)
+    {
+      req->chain = NULL;
+      last->chain = req;
+      last = req;
+      cnt += req->cnt;
+    }
+  while (cnt < MERGE_MAX
+         && (req = take_adjacent (block, first->write, first->dev_sector,
+                                  false, MERGE_MAX - cnt)) != NULL)
+    {
+      req->chain = first;
+      first = req;
+      cnt += req->cnt;
+    }
+
+  for (req = first; req != NULL; req = req->chain)
+    fair_charge (block, req);
+  block->head = last->dev_sector + last->cnt;
+  return first;
+}
+
+/* Reports to REQ's submitter that REQ has completed.  Called by
+   drivers, possibly from an interrupt handler. */
+void
+block_request_done (struct block_request *req)
+{
+  account_done (req);
+  if (req->done != NULL)
+    req->done (req, req->aux);
+  else
+    sema_up (&req->sema);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,6 +865,105 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Starts accounting REQ, just submitted to BLOCK, to BLOCK. */
+static void
+account_submit (struct block *block, struct block_request *req)
+{
+  enum intr_level old_level = intr_disable ();
+
+  req->acct = block;
+  req->start = rdtsc ();
+  if (block->stats.depth++ == 0)
+    block->busy_start = req->start;
+  if (block->stats.depth > block->stats.max_depth)
+    block->stats.max_depth = block->stats.depth;
+
+  intr_set_level (old_level);
+}
+
+/* Returns the latency histogram bucket for LATENCY. */
+static int
+latency_bucket (uint64_t latency)
+{
+  int bucket = 0;
+
+  for (latency >>= BLOCK_LATENCY_SHIFT;
+       latency > 0 && bucket < BLOCK_LATENCY_BUCKETS - 1; latency >>= 1)
+    bucket++;
+  return bucket;
+}
+
+/* Accounts the completion of REQ to the device it was submitted
+   to.  May be called from an interrupt handler. */
+static void
+account_done (struct block_request *req)
+{
+  struct block *block = req->acct;
+  struct block_op_stats *op = req->write ? &block->stats.write
+                                         : &block->stats.read;
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = rdtsc ();
+  uint64_t latency = now - req->start;
+
+  op->requests++;
+  op->bytes += (uint64_t) req->cnt * BLOCK_SECTOR_SIZE;
+  op->latency += latency;
+  if (latency > op->max_latency)
+    op->max_latency = latency;
+  op->latency_hist[latency_bucket (latency)]++;
+  if (--block->stats.depth == 0)
+    block->stats.busy += now - block->busy_start;
+
+  intr_set_level (old_level);
+}
+
+/* Copies BLOCK's statistics into *STATS. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = rdtsc ();
+
+  *stats = block->stats;
+  stats->elapsed = now - block->created;
+  stats->weight = fair_weight (block);
+  if (stats->depth > 0)
+    stats->busy += now - block->busy_start;
+
+  intr_set_level (old_level);
+}
+
+/* Prints the statistics in OP for requests in direction NAME. */
+static void
+print_op_stats (const char *name, const struct block_op_stats *op)
+{
+  int i;
+
+  if (op->requests == 0)
+    return;
+
+  printf ("  %s: %llu requests, %llu bytes, "
+          "latency avg %llu max %llu cycles\n",
+          name, op->requests, op->bytes,
+          op->latency / op->requests, op->max_latency);
+  printf ("  %s latency histogram:", name);
+  for (i = 0; i < BLOCK_LATENCY_BUCKETS - 1; i++)
+    if (op->latency_hist[i] != 0)
+      printf (" <2^%d:%u", BLOCK_LATENCY_SHIFT + i, op->latency_hist[i]);
+  if (op->latency_hist[i] != 0)
+    printf (" >=2^%d:%u", BLOCK_LATENCY_SHIFT + i - 1, op->latency_hist[i]);
+  printf ("\n");
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -171,9 +975,28 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
+          struct block_stats stats;
+          int64_t ticks = timer_elapsed (block->created_ticks);
+
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+
+          block_get_stats (block, &stats);
+          if (ticks > 0)
+            printf ("  %llu IOPS, %llu kB/s, weight %u, "
+                    "throttled %llu times\n",
+                    (stats.read.requests + stats.write.requests)
+                    * TIMER_FREQ / ticks,
+                    (stats.read.bytes + stats.write.bytes)
+                    * TIMER_FREQ / ticks / 1024,
+                    stats.weight, stats.throttled);
+          print_op_stats ("read", &stats.read);
+          print_op_stats ("write", &stats.write);
+          if (stats.max_depth > 0)
+            printf ("  max queue depth %u, busy %llu%% of %llu cycles\n",
+                    stats.max_depth, stats.busy * 100 / stats.elapsed,
+                    stats.elapsed);
         }
     }
 }
@@ -200,6 +1023,18 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  list_init (&block->queue);
+  block->head = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->created = rdtsc ();
+  block->busy_start = 0;
+  block->created_ticks = timer_ticks ();
+  block->vtime = 0;
+  block->queued = 0;
+  block->vclock = 0;
+  lock_init (&block->wc_lock);
+  block->wc_data = NULL;
+  block->wc_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
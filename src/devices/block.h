@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <blockstat.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,10 +56,59 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_write_combine (struct block *, block_sector_t, size_t cnt,
+                          const void *);
+void block_flush (struct block *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+
+struct block_request;
+
+/* Called when a request completes. */
+typedef void block_request_func (struct block_request *, void *aux);
+
+/* A request to transfer a run of sectors between a block device
+   and memory, which completes while its submitter goes on. */
+struct block_request
+  {
+    /* Set by block_request_init(). */
+    bool write;                 /* Write to the device? */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_request_func *done;   /* Completion callback, or null. */
+    void *aux;                  /* Passed to DONE. */
+
+    /* Owned by the block layer and drivers. */
+    block_sector_t dev_sector;  /* First sector on the device now
+                                   servicing the request. */
+    struct list_elem elem;      /* Element in a device queue. */
+    struct block_request *chain; /* Next request merged into the same
+                                    transfer, or null. */
+    int64_t deadline;           /* Timer tick to dispatch it by. */
+    struct block *acct;         /* Device it is accounted to. */
+    uint64_t start;             /* Time-stamp counter at submission. */
+    struct semaphore sema;      /* Up'd on completion if DONE is null. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, size_t cnt, void *buffer,
+                         block_request_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
+/* I/O scheduling. */
+bool block_set_scheduler (const char *name);
+bool block_set_weight (const char *role, unsigned weight);
+
 /* Statistics. */
+void block_get_stats (struct block *, struct block_stats *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
@@ -65,10 +117,32 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors at once.  Optional: if
+       null, the block layer transfers one sector at a time. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Starts a request for REQ->dev_sector onward and returns
+       without waiting for it, calling block_request_done() when it
+       completes.  Optional: if null, the block layer services
+       requests synchronously with the operations above, which
+       need not be provided otherwise. */
+    void (*submit) (void *aux, struct block_request *req);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
 
+/* Request queues, for drivers that provide submit().  Interrupts
+   must be off.  block_dequeue() returns a chain of requests for
+   consecutive sectors, linked through their CHAIN members, to be
+   carried out as one transfer. */
+void block_enqueue (struct block *, struct block_request *);
+struct block_request *block_dequeue (struct block *);
+void block_request_done (struct block_request *);
+
 #endif /* devices/block.h */
@@ -5,10 +5,13 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +33,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, on channels whose controller
+   supports DMA. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer direction: disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ERROR 0x02       /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt raised (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +67,29 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors one READ or WRITE command can transfer, encoded as
+   0 in the Sector Count register. */
+#define MAX_COMMAND_SECTORS 256
+
+/* Physical region descriptor: one physically contiguous piece of
+   a DMA buffer, in the table the bus master walks. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 for 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last descriptor. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Descriptors in a table, which takes one page. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +98,10 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Does the disk support DMA? */
+    struct block *block;        /* Registered block device, if any. */
   };
 
 /* An ATA channel (aka controller).
@@ -66,11 +111,25 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base I/O port, if any. */
+    struct prd *prdt;           /* PRD table, null if DMA is unavailable. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
-    struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct semaphore completion_wait;   /* Up'd by interrupt handler while
+                                           probing the disks. */
+
+    /* Request in progress, carried out by the interrupt handler.
+       Protected by disabling interrupts. */
+    struct block_request *active;       /* Active chain of merged
+                                           requests, or null. */
+    struct ata_disk *active_disk;       /* Disk it is for. */
+    size_t req_cnt;             /* Sectors in the whole chain. */
+    size_t req_done;            /* Sectors of it done by past commands. */
+    size_t cmd_cnt;             /* Sectors in the current command. */
+    size_t cmd_done;            /* Sectors moved by the current PIO command. */
+    bool dma;                   /* Is the current command using DMA? */
+    int next_dev_no;            /* Disk whose queue to try first. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
@@ -84,14 +143,24 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
-
-static void select_sector (struct ata_disk *, block_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static void set_multiple_mode (struct ata_disk *, int cnt);
+static uint16_t find_bus_master (void);
+
+static void start_next_request (struct channel *);
+static void start_command (struct channel *);
+static bool dma_start (struct channel *, block_sector_t);
+static void dma_finish (struct channel *, uint8_t status);
+static void pio_transfer_block (struct channel *);
+static void request_interrupt (struct channel *);
+
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool wait_for_drq (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -101,6 +170,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +193,15 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->active = NULL;
+      c->next_dev_no = 0;
+
+      /* Use DMA if there is a bus master.  Each channel has its
+         own 8 bus master registers. */
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      c->prdt = bm_base != 0 ? palloc_get_page (0) : NULL;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +212,9 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          d->block = NULL;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +236,38 @@ ide_init (void)
 
 /* Disk detection and identification. */
 
+/* PCI class and subclass of IDE controllers. */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+/* IDE controller programming interface bits. */
+#define PROG_IF_NATIVE 0x05     /* Either channel in native PCI mode. */
+#define PROG_IF_BUS_MASTER 0x80 /* Supports bus mastering. */
+
+/* Looks for a PCI IDE controller, such as the PIIX emulated by
+   QEMU, that can do bus master DMA on the legacy channels.
+   Enables bus mastering on it and returns its bus master base
+   I/O port, or returns 0 if there is none, in which case all
+   transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_dev dev;
+  uint8_t prog_if;
+  uint16_t base;
+
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &dev))
+    return 0;
+  prog_if = pci_read_config (&dev, PCI_REG_CLASS) >> 8;
+  if ((prog_if & PROG_IF_BUS_MASTER) == 0
+      || (prog_if & PROG_IF_NATIVE) != 0)
+    return 0;
+  base = pci_io_base (&dev, 4);
+  if (base != 0)
+    pci_enable (&dev, PCI_CMD_IO | PCI_CMD_MASTER);
+  return base;
+}
+
 static char *descramble_ata_string (char *, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -272,7 +383,7 @@ identify_ata_device (struct ata_disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -303,12 +414,41 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Transfer runs of sectors in the largest blocks the disk
+     allows between interrupts.  Use DMA if the disk supports it
+     (bit 8 of word 49). */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+  d->dma = (id[49 * 2 + 1] & 0x01) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  d->block = block;
   partition_scan (block);
 }
 
+/* Enables READ MULTIPLE and WRITE MULTIPLE on disk D with CNT
+   sectors per block, the maximum reported in word 47 of its
+   IDENTIFY DEVICE data.  Leaves them disabled if CNT is 0 or the
+   disk rejects the setting. */
+static void
+set_multiple_mode (struct ata_disk *d, int cnt)
+{
+  struct channel *c = d->channel;
+
+  d->multiple = 0;
+  if (cnt == 0)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +477,284 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Queues REQ, a request for disk D, behind any others waiting for
+   D's channel, and starts it if the channel is idle.  The
+   channel's interrupt handler carries it out from there. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_submit (void *d_, struct block_request *req)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
-}
+  enum intr_level old_level = intr_disable ();
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
-{
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  block_enqueue (d->block, req);
+  if (c->active == NULL)
+    start_next_request (c);
+  intr_set_level (old_level);
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    .submit = ide_submit
   };
+
+/* Makes the next queued request for a disk on channel C active
+   and starts it, taking the two disks' queues in turn, or leaves
+   C idle if no request is waiting.  Interrupts must be off. */
+static void
+start_next_request (struct channel *c)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c->active = NULL;
+  for (i = 0; i < 2; i++)
+    {
+      struct ata_disk *d = &c->devices[(c->next_dev_no + i) % 2];
+      struct block_request *req;
+
+      if (d->block == NULL)
+        continue;
+      req = block_dequeue (d->block);
+      if (req != NULL)
+        {
+          c->active = req;
+          c->active_disk = d;
+          c->req_cnt = 0;
+          for (; req != NULL; req = req->chain)
+            c->req_cnt += req->cnt;
+          c->req_done = 0;
+          c->next_dev_no = (d->dev_no + 1) % 2;
+          start_command (c);
+          return;
+        }
+    }
+}
+
+/* Issues the command for the next up to MAX_COMMAND_SECTORS
+   sectors of channel C's active requests, by DMA if possible and
+   in PIO mode otherwise.  Interrupts must be off. */
+static void
+start_command (struct channel *c)
+{
+  struct block_request *req = c->active;
+  struct ata_disk *d = c->active_disk;
+  size_t left = c->req_cnt - c->req_done;
+  block_sector_t sec_no = req->dev_sector + c->req_done;
+
+  c->cmd_cnt = left < MAX_COMMAND_SECTORS ? left : MAX_COMMAND_SECTORS;
+  c->cmd_done = 0;
+  c->dma = dma_start (c, sec_no);
+  if (!c->dma)
+    {
+      select_sector (d, sec_no, c->cmd_cnt);
+      if (req->write)
+        {
+          issue_command (c, (d->multiple > 0
+                             ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+          pio_transfer_block (c);
+        }
+      else
+        issue_command (c, (d->multiple > 0
+                           ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+    }
+}
+
+/* Returns the address of sector IDX of channel C's active
+   transfer, in the buffer of whichever of the chain of merged
+   requests it belongs to.  Stores in *CNT the number of sectors
+   from there to the end of that buffer. */
+static uint8_t *
+transfer_buffer (struct channel *c, size_t idx, size_t *cnt)
+{
+  struct block_request *req = c->active;
+
+  while (idx >= req->cnt)
+    {
+      idx -= req->cnt;
+      req = req->chain;
+    }
+  *cnt = req->cnt - idx;
+  return (uint8_t *) req->buffer + idx * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the address of the next sector of channel C's current
+   PIO command. */
+static uint8_t *
+next_buffer (struct channel *c)
+{
+  size_t cnt;
+  return transfer_buffer (c, c->req_done + c->cmd_done, &cnt);
+}
+
+/* Starts a bus master DMA transfer of channel C's current command,
+   starting at SEC_NO.  The completion interrupt arrives when the
+   controller has moved all of the data, which leaves the CPU free
+   in the meantime.  Returns false, without doing anything, if DMA
+   cannot be used: the controller or disk does not support it, a
+   buffer is not word-aligned kernel memory, or the buffers are
+   too scattered for the PRD table. */
+static bool
+dma_start (struct channel *c, block_sector_t sec_no)
+{
+  struct ata_disk *d = c->active_disk;
+  bool write = c->active->write;
+  size_t idx = c->req_done;
+  size_t left = c->cmd_cnt;
+  size_t prd_cnt = 0;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+
+  if (c->prdt == NULL || !d->dma)
+    return false;
+
+  /* Describe each request's buffer a page at a time, so that no
+     region crosses a page or 64 kB boundary. */
+  while (left > 0)
+    {
+      size_t cnt;
+      uint8_t *p = transfer_buffer (c, idx, &cnt);
+      size_t size;
+
+      if (cnt > left)
+        cnt = left;
+      if (!is_kernel_vaddr (p) || (uintptr_t) p % 2 != 0)
+        return false;
+      idx += cnt;
+      left -= cnt;
+
+      for (size = cnt * BLOCK_SECTOR_SIZE; size > 0; )
+        {
+          size_t chunk = PGSIZE - pg_ofs (p);
+          if (chunk > size)
+            chunk = size;
+          if (prd_cnt >= PRD_CNT)
+            return false;
+          c->prdt[prd_cnt].addr = vtop (p);
+          c->prdt[prd_cnt].size = chunk;
+          c->prdt[prd_cnt].flags = 0;
+          prd_cnt++;
+          p += chunk;
+          size -= chunk;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  outb (reg_bm_command (c), direction);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_status (c), BM_STA_ERROR | BM_STA_INTR);
+  select_sector (d, sec_no, c->cmd_cnt);
+  issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+
+  /* The controller must see the buffer and the table as they are
+     now. */
+  barrier ();
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  return true;
+}
+
+/* Stops channel C's finished DMA transfer.  STATUS is the
+   device's status at completion.  Panics if the transfer
+   failed. */
+static void
+dma_finish (struct channel *c, uint8_t status)
+{
+  uint8_t bm_status = inb (reg_bm_status (c));
+
+  outb (reg_bm_command (c), c->active->write ? 0 : BM_CMD_READ);
+  outb (reg_bm_status (c), BM_STA_ERROR | BM_STA_INTR);
+  if ((bm_status & BM_STA_ERROR) != 0 || (status & STA_ERR) != 0)
+    PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+           c->active_disk->name, c->active->write ? "write" : "read",
+           c->active->dev_sector + c->req_done);
+  barrier ();
+}
+
+/* Moves the next block of channel C's current PIO command through
+   the data register: D->multiple sectors if READ/WRITE MULTIPLE
+   is enabled, one otherwise.  The disk must be ready for it, or
+   about to be.  Panics if the disk reports an error. */
+static void
+pio_transfer_block (struct channel *c)
+{
+  struct ata_disk *d = c->active_disk;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+  size_t left = c->cmd_cnt - c->cmd_done;
+  size_t n = left < per_intr ? left : per_intr;
+  size_t i;
+
+  if (!wait_for_drq (d))
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+           c->active->write ? "write" : "read",
+           c->active->dev_sector + c->req_done + c->cmd_done);
+  for (i = 0; i < n; i++)
+    {
+      if (c->active->write)
+        output_sector (c, next_buffer (c));
+      else
+        input_sector (c, next_buffer (c));
+      c->cmd_done++;
+    }
+}
+
+/* Handles an interrupt on channel C while a request is active:
+   moves the next block of a PIO transfer, and once a command has
+   finished, issues the next one or completes the request and
+   starts the next request. */
+static void
+request_interrupt (struct channel *c)
+{
+  struct block_request *req = c->active;
+  uint8_t status = inb (reg_status (c));        /* Acknowledge interrupt. */
+
+  /* A PIO read command finishes once its last block has been read,
+     a PIO write command with the interrupt after its last block
+     has been written. */
+  if (c->dma)
+    dma_finish (c, status);
+  else if (!req->write)
+    {
+      pio_transfer_block (c);
+      if (c->cmd_done < c->cmd_cnt)
+        return;
+    }
+  else if (c->cmd_done < c->cmd_cnt)
+    {
+      pio_transfer_block (c);
+      return;
+    }
+  else if ((status & STA_ERR) != 0)
+    PANIC ("%s: disk write failed, sector=%"PRDSNu,
+           c->active_disk->name, req->dev_sector + c->req_done);
+
+  c->req_done += c->cmd_cnt;
+  if (c->req_done < c->req_cnt)
+    start_command (c);
+  else
+    {
+      while (req != NULL)
+        {
+          struct block_request *next = req->chain;
+          block_request_done (req);
+          req = next;
+        }
+      start_next_request (c);
+    }
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT to the disk's
+   sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_COMMAND_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_COMMAND_SECTORS);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -404,12 +765,8 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
-  /* Interrupts must be enabled or our semaphore will never be
-     up'd by the completion handler. */
-  ASSERT (intr_get_level () == INTR_ON);
-
   c->expecting_interrupt = true;
   outb (reg_command (c), command);
 }
@@ -446,7 +803,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +836,26 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Busy-waits up to a second for disk D to clear BSY, and then
+   returns true if DRQ is set and ERR is not.  Unlike
+   wait_while_busy(), works with interrupts off, as in the
+   interrupt handler. */
+static bool
+wait_for_drq (const struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 100000; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if (!(status & STA_BSY))
+        return (status & (STA_DRQ | STA_ERR)) == STA_DRQ;
+      timer_udelay (10);
+    }
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +866,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -511,7 +888,9 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (c->active != NULL)
+          request_interrupt (c);
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
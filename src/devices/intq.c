@@ -2,7 +2,7 @@
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
+static int next (const struct intq *q, int pos);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
@@ -10,8 +10,21 @@ static void signal (struct intq *q, struct thread **waiter);
 void
 intq_init (struct intq *q) 
 {
+  intq_init_buf (q, q->inline_buf, sizeof q->inline_buf);
+}
+
+/* Initializes interrupt queue Q to hold its data in the SIZE
+   bytes at BUF, which must outlive Q, instead of its own
+   INTQ_BUFSIZE-byte buffer. */
+void
+intq_init_buf (struct intq *q, uint8_t *buf, size_t size)
+{
+  ASSERT (buf != NULL && size > 1);
+
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
+  q->buf = buf;
+  q->size = size;
   q->head = q->tail = 0;
 }
 
@@ -28,7 +41,7 @@ bool
 intq_full (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return next (q, q->head) == q->tail;
 }
 
 /* Removes a byte from Q and returns it.
@@ -49,7 +62,7 @@ intq_getc (struct intq *q)
     }
   
   byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  q->tail = next (q, q->tail);
   signal (q, &q->not_full);
   return byte;
 }
@@ -70,15 +83,33 @@ intq_putc (struct intq *q, uint8_t byte)
     }
 
   q->buf[q->head] = byte;
-  q->head = next (q->head);
+  q->head = next (q, q->head);
   signal (q, &q->not_empty);
 }
 
-/* Returns the position after POS within an intq. */
+/* Adds as many of the N bytes in BUF to the end of Q as fit,
+   without sleeping, and returns the number added. */
+size_t
+intq_putbuf (struct intq *q, const uint8_t *buf, size_t n)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  for (i = 0; i < n && !intq_full (q); i++)
+    {
+      q->buf[q->head] = buf[i];
+      q->head = next (q, q->head);
+    }
+  if (i > 0)
+    signal (q, &q->not_empty);
+  return i;
+}
+
+/* Returns the position after POS within Q. */
 static int
-next (int pos) 
+next (const struct intq *q, int pos) 
 {
-  return (pos + 1) % INTQ_BUFSIZE;
+  return (pos + 1) % q->size;
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <stddef.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -17,7 +18,8 @@
    protect kernel threads from one another, not from interrupt
    handlers. */
 
-/* Queue buffer size, in bytes. */
+/* Queue buffer size, in bytes, unless the owner supplies its own
+   buffer with intq_init_buf(). */
 #define INTQ_BUFSIZE 64
 
 /* A circular queue of bytes. */
@@ -29,15 +31,19 @@ struct intq
     struct thread *not_empty;   /* Thread waiting for not-empty condition. */
 
     /* Queue. */
-    uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
+    uint8_t *buf;               /* Buffer. */
+    int size;                   /* Size of BUF, in bytes. */
+    uint8_t inline_buf[INTQ_BUFSIZE];   /* Default buffer. */
     int head;                   /* New data is written here. */
     int tail;                   /* Old data is read here. */
   };
 
 void intq_init (struct intq *);
+void intq_init_buf (struct intq *, uint8_t *buf, size_t size);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+size_t intq_putbuf (struct intq *, const uint8_t *, size_t);
 
 #endif /* devices/intq.h */
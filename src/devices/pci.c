@@ -0,0 +1,175 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* The code in this file accesses PCI configuration space with
+   configuration mechanism #1, which every PC chipset since the
+   original PCI ones supports.  It only finds devices; drivers
+   program them themselves. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8        /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc           /* Data of the selected register. */
+
+/* Enables the configuration cycle in PCI_CONFIG_ADDRESS. */
+#define PCI_CONFIG_ENABLE 0x80000000
+
+/* A function with this vendor ID does not exist. */
+#define PCI_NO_VENDOR 0xffff
+
+/* Header type bit for devices with more than one function. */
+#define PCI_HEADER_MULTIFUNCTION 0x80
+
+/* Selects register REG of DEV in PCI_CONFIG_ADDRESS. */
+static void
+select_register (const struct pci_dev *dev, uint8_t reg)
+{
+  ASSERT (reg % 4 == 0);
+  ASSERT (dev->slot < 32 && dev->func < 8);
+
+  outl (PCI_CONFIG_ADDRESS, (PCI_CONFIG_ENABLE | (dev->bus << 16)
+                             | (dev->slot << 11) | (dev->func << 8) | reg));
+}
+
+/* Returns the 32-bit configuration register REG of DEV.  REG
+   must be a multiple of 4. */
+uint32_t
+pci_read_config (const struct pci_dev *dev, uint8_t reg)
+{
+  select_register (dev, reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit configuration register REG of DEV.
+   REG must be a multiple of 4. */
+void
+pci_write_config (const struct pci_dev *dev, uint8_t reg, uint32_t value)
+{
+  select_register (dev, reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Calls MATCH on every PCI function in bus order, passing AUX,
+   until it returns true.  Stores that function in *DEV and
+   returns true, or returns false if MATCH never does. */
+static bool
+scan (bool (*match) (const struct pci_dev *, void *aux), void *aux,
+      struct pci_dev *dev)
+{
+  int bus, slot, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (slot = 0; slot < 32; slot++)
+      for (func = 0; func < 8; func++)
+        {
+          dev->bus = bus;
+          dev->slot = slot;
+          dev->func = func;
+          if ((pci_read_config (dev, PCI_REG_ID) & 0xffff) == PCI_NO_VENDOR)
+            {
+              if (func == 0)
+                break;
+              continue;
+            }
+          if (match (dev, aux))
+            return true;
+          if (func == 0
+              && !((pci_read_config (dev, PCI_REG_HEADER) >> 16)
+                   & PCI_HEADER_MULTIFUNCTION))
+            break;
+        }
+  return false;
+}
+
+/* Returns true if DEV's vendor and device IDs are those in
+   *AUX, packed as they are in the ID register. */
+static bool
+match_id (const struct pci_dev *dev, void *aux)
+{
+  return pci_read_config (dev, PCI_REG_ID) == *(uint32_t *) aux;
+}
+
+/* PCI functions found by pci_find_devices(). */
+struct found_devices
+  {
+    uint32_t id;                /* IDs to look for, as in match_id(). */
+    struct pci_dev *devs;       /* Functions found so far. */
+    size_t cnt;                 /* Number of them. */
+    size_t max;                 /* Room in DEVS. */
+  };
+
+/* Adds DEV to the struct found_devices in AUX if it has the IDs
+   it is looking for.  Returns true once it is full. */
+static bool
+collect_id (const struct pci_dev *dev, void *aux)
+{
+  struct found_devices *found = aux;
+
+  if (match_id (dev, &found->id))
+    found->devs[found->cnt++] = *dev;
+  return found->cnt >= found->max;
+}
+
+/* Finds up to MAX PCI functions with the given VENDOR and DEVICE
+   IDs, stores their addresses in DEVS in bus order, and returns
+   the number found. */
+size_t
+pci_find_devices (uint16_t vendor, uint16_t device,
+                  struct pci_dev devs[], size_t max)
+{
+  struct found_devices found;
+  struct pci_dev dev;
+
+  found.id = ((uint32_t) device << 16) | vendor;
+  found.devs = devs;
+  found.cnt = 0;
+  found.max = max;
+  if (max > 0)
+    scan (collect_id, &found, &dev);
+  return found.cnt;
+}
+
+/* Returns true if DEV's class and subclass codes are those in
+   *AUX, packed as they are in the top half of the class
+   register. */
+static bool
+match_class (const struct pci_dev *dev, void *aux)
+{
+  return pci_read_config (dev, PCI_REG_CLASS) >> 16 == *(uint32_t *) aux;
+}
+
+/* Finds the first PCI function with the given CLASS and SUBCLASS
+   codes and stores its address in *DEV.  Returns true if
+   successful, false if there is none. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *dev)
+{
+  uint32_t code = ((uint32_t) class << 8) | subclass;
+  return scan (match_class, &code, dev);
+}
+
+/* Returns the I/O port base that DEV's base address register BAR
+   (0...5) decodes, or 0 if it is unset or decodes memory
+   space. */
+uint16_t
+pci_io_base (const struct pci_dev *dev, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (dev, PCI_REG_BAR0 + bar * 4);
+  return (value & 1) != 0 ? value & 0xfffc : 0;
+}
+
+/* Sets COMMAND_BITS, some of the PCI_CMD_* bits, in DEV's command
+   register. */
+void
+pci_enable (const struct pci_dev *dev, uint16_t command_bits)
+{
+  uint32_t value = pci_read_config (dev, PCI_REG_COMMAND);
+
+  /* The upper half is the status register, whose bits are cleared
+     by writing 1s, so write 0s there. */
+  pci_write_config (dev, PCI_REG_COMMAND,
+                    (value & 0xffff) | command_bits);
+}
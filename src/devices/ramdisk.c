@@ -0,0 +1,170 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in memory.
+
+   Its contents are held in pages that need not be contiguous, so
+   that a large RAM disk can be allocated after boot.  Transfers
+   are plain copies carried out synchronously by the block layer,
+   so the file system and swap run at memory speed, which makes
+   their CPU overheads measurable apart from disk latency.
+
+   The RAM disk is named "ram0" and has no role by default: pick
+   it with -filesys=ram0 or -swap=ram0.  Its contents are lost at
+   shutdown. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Most pages taken from the kernel pool once the user pool runs
+   out, so that the file system and new threads, which can only
+   use the kernel pool, still find room. */
+#define KERNEL_PAGE_MAX 64
+
+/* The RAM disk. */
+static struct block *ramdisk;
+static uint8_t **pages;                 /* Pages holding the sectors. */
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a zero-filled RAM disk of KB kilobytes, rounded up to a
+   whole page, and registers it as block device "ram0".  Pages
+   come from the user pool while it lasts, then from at most
+   KERNEL_PAGE_MAX pages of the kernel pool.  Panics if memory runs
+   out. */
+void
+ramdisk_init (size_t kb)
+{
+  size_t page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  size_t kernel_cnt = 0;
+  size_t i;
+
+  ASSERT (ramdisk == NULL);
+  ASSERT (page_cnt > 0);
+
+  pages = malloc (page_cnt * sizeof *pages);
+  if (pages == NULL)
+    PANIC ("ram0: out of memory");
+  for (i = 0; i < page_cnt; i++)
+    {
+      pages[i] = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (pages[i] == NULL && kernel_cnt < KERNEL_PAGE_MAX)
+        {
+          pages[i] = palloc_get_page (PAL_ZERO);
+          kernel_cnt++;
+        }
+      if (pages[i] == NULL)
+        PANIC ("ram0: out of memory after %zu of %zu kB",
+               i * PGSIZE / 1024, page_cnt * PGSIZE / 1024);
+    }
+
+  ramdisk = block_register ("ram0", BLOCK_RAW, "RAM disk",
+                            page_cnt * SECTORS_PER_PAGE,
+                            &ramdisk_operations, NULL);
+}
+
+/* Copies the start of the scratch device into the RAM disk, as
+   much of it as fits. */
+void
+ramdisk_load (void)
+{
+  struct block *scratch = block_get_role (BLOCK_SCRATCH);
+  block_sector_t size, sector;
+
+  if (ramdisk == NULL)
+    PANIC ("ram0: no RAM disk to load (use -ramdisk)");
+  if (scratch == NULL)
+    PANIC ("ram0: no scratch device to load from");
+
+  size = block_size (scratch);
+  if (size > block_size (ramdisk))
+    size = block_size (ramdisk);
+  for (sector = 0; sector < size; sector += SECTORS_PER_PAGE)
+    {
+      size_t cnt = size - sector < SECTORS_PER_PAGE
+                   ? size - sector : SECTORS_PER_PAGE;
+      block_read_multiple (scratch, sector, cnt,
+                           pages[sector / SECTORS_PER_PAGE]);
+    }
+  printf ("ram0: loaded %"PRDSNu" sectors from %s\n",
+          size, block_name (scratch));
+}
+
+/* Returns the address of SECTOR and stores in *CNT the number of
+   the CNT sectors starting there that lie in the same page. */
+static uint8_t *
+locate_sector (block_sector_t sector, size_t *cnt)
+{
+  size_t ofs = sector % SECTORS_PER_PAGE;
+
+  if (*cnt > SECTORS_PER_PAGE - ofs)
+    *cnt = SECTORS_PER_PAGE - ofs;
+  return pages[sector / SECTORS_PER_PAGE] + ofs * BLOCK_SECTOR_SIZE;
+}
+
+/* Reads CNT sectors starting at SECTOR into BUFFER. */
+static void
+ramdisk_read_multiple (void *aux UNUSED, block_sector_t sector,
+                       size_t cnt, void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      size_t run = cnt;
+      const uint8_t *src = locate_sector (sector, &run);
+
+      memcpy (buffer, src, run * BLOCK_SECTOR_SIZE);
+      buffer += run * BLOCK_SECTOR_SIZE;
+      sector += run;
+      cnt -= run;
+    }
+}
+
+/* Writes CNT sectors starting at SECTOR from BUFFER. */
+static void
+ramdisk_write_multiple (void *aux UNUSED, block_sector_t sector,
+                        size_t cnt, const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      size_t run = cnt;
+      uint8_t *dst = locate_sector (sector, &run);
+
+      memcpy (dst, buffer, run * BLOCK_SECTOR_SIZE);
+      buffer += run * BLOCK_SECTOR_SIZE;
+      sector += run;
+      cnt -= run;
+    }
+}
+
+/* Reads SECTOR into BUFFER. */
+static void
+ramdisk_read (void *aux, block_sector_t sector, void *buffer)
+{
+  ramdisk_read_multiple (aux, sector, 1, buffer);
+}
+
+/* Writes SECTOR from BUFFER. */
+static void
+ramdisk_write (void *aux, block_sector_t sector, const void *buffer)
+{
+  ramdisk_write_multiple (aux, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .read_multiple = ramdisk_read_multiple,
+    .write_multiple = ramdisk_write_multiple,
+  };
@@ -1,5 +1,6 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <string.h>
 #include "devices/input.h"
 #include "devices/intq.h"
 #include "devices/timer.h"
@@ -33,6 +34,17 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RX 0x02       /* Clear receive FIFO. */
+#define FCR_CLEAR_TX 0x04       /* Clear transmit FIFO. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled (16550A and later). */
+
+/* Transmit FIFO size of the 16550A. */
+#define TX_FIFO_SIZE 16
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -51,8 +63,15 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
+/* Data to be transmitted, in a buffer big enough to absorb a
+   burst of console output. */
+#define TXQ_SIZE 1024
 static struct intq txq;
+static uint8_t txq_buf[TXQ_SIZE];
+
+/* Bytes the transmitter accepts each time it becomes empty: the
+   FIFO size if it has a working FIFO, otherwise 1. */
+static int tx_burst;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
@@ -71,7 +90,7 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  intq_init_buf (&txq, txq_buf, sizeof txq_buf);
   mode = POLL;
 } 
 
@@ -88,6 +107,19 @@ serial_init_queue (void)
   ASSERT (mode == POLL);
 
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
+
+  /* Enable the FIFOs, so that each transmit interrupt can send a
+     whole burst.  An 8250 or 16450 has none, and a 16550 without
+     the A has a broken one. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    tx_burst = TX_FIFO_SIZE;
+  else
+    {
+      outb (FCR_REG, 0);
+      tx_burst = 1;
+    }
+
   mode = QUEUE;
   old_level = intr_disable ();
   write_ier ();
@@ -129,6 +161,56 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUF to the serial port.  Faster than
+   calling serial_putc() for each byte, because interrupts are
+   disabled and the transmitter is kicked once per chunk rather
+   than once per byte. */
+void
+serial_putbuf (const uint8_t *buf, size_t n)
+{
+  while (n > 0)
+    {
+      /* BUF may be in user memory, so copy each chunk before
+         disabling interrupts, in case it page faults. */
+      uint8_t chunk[64];
+      size_t chunk_size = n < sizeof chunk ? n : sizeof chunk;
+      size_t ofs = 0;
+      enum intr_level old_level;
+
+      memcpy (chunk, buf, chunk_size);
+      buf += chunk_size;
+      n -= chunk_size;
+
+      old_level = intr_disable ();
+      if (mode != QUEUE)
+        {
+          for (; ofs < chunk_size; ofs++)
+            serial_putc (chunk[ofs]);
+        }
+      else
+        while (ofs < chunk_size)
+          {
+            ofs += intq_putbuf (&txq, chunk + ofs, chunk_size - ofs);
+            if (ofs < chunk_size)
+              {
+                /* The queue is full.  As in serial_putc(), poll if
+                   interrupts are off, otherwise wait for the
+                   transmitter to drain it. */
+                if (old_level == INTR_OFF)
+                  putc_poll (intq_getc (&txq));
+                else
+                  {
+                    write_ier ();
+                    intq_putc (&txq, chunk[ofs++]);
+                  }
+              }
+          }
+      if (mode == QUEUE)
+        write_ier ();
+      intr_set_level (old_level);
+    }
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -218,10 +300,15 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the transmitter is empty, refill it with as many bytes as
+     it holds. */
+  if ((inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      int i;
+
+      for (i = 0; i < tx_burst && !intq_empty (&txq); i++)
+        outb (THR_REG, intq_getc (&txq));
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
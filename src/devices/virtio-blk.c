@@ -0,0 +1,439 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for virtio block devices, the
+   paravirtualized disks that QEMU provides with "-drive
+   if=virtio", through the legacy PCI interface described in
+   [VIRTIO-0.9.5].  Unlike an emulated IDE disk, which takes a trap
+   into the emulator for every register access, a virtio disk is
+   handed whole requests through a ring in memory and works on
+   several of them at once. */
+
+/* PCI vendor and device IDs of a legacy virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_DEVICE_BLK 0x1001
+
+/* Legacy virtio port addresses. */
+#define reg_features(DISK) ((DISK)->io_base + 0x00)     /* Device features. */
+#define reg_guest_features(DISK) ((DISK)->io_base + 0x04) /* Driver's. */
+#define reg_queue_pfn(DISK) ((DISK)->io_base + 0x08)    /* Ring page number. */
+#define reg_queue_size(DISK) ((DISK)->io_base + 0x0c)   /* Ring size (r/o). */
+#define reg_queue_select(DISK) ((DISK)->io_base + 0x0e) /* Ring to configure. */
+#define reg_queue_notify(DISK) ((DISK)->io_base + 0x10) /* Ring has work. */
+#define reg_status(DISK) ((DISK)->io_base + 0x12)       /* Device status. */
+#define reg_isr(DISK) ((DISK)->io_base + 0x13)          /* Interrupt status. */
+#define reg_config(DISK) ((DISK)->io_base + 0x14)       /* Device config. */
+
+/* Device Status Register bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Driver has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Driver knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on it. */
+
+/* Interrupt Status Register bits. */
+#define ISR_QUEUE 0x01          /* Used ring was updated. */
+
+/* Block device feature bits. */
+#define VIRTIO_BLK_F_SEG_MAX (1u << 2)  /* Limits segments per request. */
+
+/* Block device configuration, at reg_config():
+   64-bit capacity in sectors, 32-bit maximum segment size,
+   32-bit maximum number of segments. */
+#define CONFIG_CAPACITY 0
+#define CONFIG_SEG_MAX 12
+
+/* Block request types and status. */
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0       /* Success. */
+
+/* Descriptor flags. */
+#define VRING_DESC_F_NEXT 1     /* Continues in NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Written by the device. */
+
+/* Legacy rings are laid out with the used ring page-aligned. */
+#define VRING_ALIGN PGSIZE
+
+/* Largest ring we will allocate. */
+#define MAX_QUEUE_SIZE 1024
+
+/* Descriptor: one physically contiguous buffer of a request. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_*. */
+    uint16_t next;              /* Next descriptor, if F_NEXT. */
+  };
+
+/* Available ring: requests offered to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Used ring: requests the device has finished. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written into it. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header that begins every block request. */
+struct virtio_blk_req
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+
+/* Descriptors set aside for each request slot: a header, up to
+   SLOT_SEGS data buffers, and a status byte. */
+#define DESC_PER_SLOT 16
+#define SLOT_SEGS (DESC_PER_SLOT - 2)
+
+/* Most requests a disk keeps in flight. */
+#define MAX_SLOTS 16
+
+/* One request in flight, made of one or more block requests for
+   consecutive sectors. */
+struct slot
+  {
+    struct virtio_blk_req hdr;  /* Read by the device. */
+    uint8_t status;             /* Written by the device. */
+    struct block_request *req;  /* Chain of block requests, or null
+                                   if the slot is free. */
+  };
+
+/* A virtio disk. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    struct pci_dev dev;         /* PCI function. */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt in use. */
+    struct block *block;        /* Registered block device. */
+
+    /* The request ring. */
+    uint16_t queue_size;        /* Descriptors in the ring. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used;   /* Used ring. */
+    uint16_t last_used;         /* Used ring entries consumed so far. */
+
+    /* Requests in flight.  Protected by disabling interrupts. */
+    size_t slot_cnt;            /* Slots that fit in the ring. */
+    size_t max_segs;            /* Data buffers per slot. */
+    struct slot slots[MAX_SLOTS];
+    struct block_request *pending;      /* Dequeued chain that did not
+                                           fit in one slot, or null. */
+  };
+
+/* Virtio disks found. */
+#define DISK_CNT 4
+static struct virtio_disk disks[DISK_CNT];
+static size_t disk_cnt;
+
+static struct block_operations virtio_blk_operations;
+
+static bool setup_disk (struct virtio_disk *);
+static bool setup_queue (struct virtio_disk *);
+static void start_requests (struct virtio_disk *);
+static void issue_request (struct virtio_disk *, size_t slot_idx);
+static void complete_requests (struct virtio_disk *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Detects virtio disks and registers them. */
+void
+virtio_blk_init (void)
+{
+  struct pci_dev devs[DISK_CNT];
+  size_t dev_cnt = pci_find_devices (VIRTIO_VENDOR, VIRTIO_DEVICE_BLK,
+                                     devs, DISK_CNT);
+  size_t i;
+
+  for (i = 0; i < dev_cnt; i++)
+    {
+      struct virtio_disk *d = &disks[disk_cnt];
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      d->dev = devs[i];
+      if (setup_disk (d))
+        {
+          disk_cnt++;
+          partition_scan (d->block);
+        }
+    }
+}
+
+/* Brings up disk D and registers it as a block device.  Returns
+   true if successful, false if D cannot be used. */
+static bool
+setup_disk (struct virtio_disk *d)
+{
+  static bool irq_registered[16];
+  uint8_t line = pci_read_config (&d->dev, PCI_REG_IRQ) & 0xff;
+  uint32_t features;
+  uint64_t capacity;
+  char extra_info[64];
+
+  d->io_base = pci_io_base (&d->dev, 0);
+  d->irq = line + 0x20;
+  if (d->io_base == 0 || line >= 16)
+    {
+      printf ("%s: no I/O ports or interrupt assigned, ignoring\n",
+              d->name);
+      return false;
+    }
+  pci_enable (&d->dev, PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset the device and announce ourselves. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+
+  /* Accept only the segment limit, so that we can keep to it. */
+  features = inl (reg_features (d)) & VIRTIO_BLK_F_SEG_MAX;
+  outl (reg_guest_features (d), features);
+  d->max_segs = SLOT_SEGS;
+  if (features & VIRTIO_BLK_F_SEG_MAX)
+    {
+      uint32_t seg_max = inl (reg_config (d) + CONFIG_SEG_MAX);
+      if (seg_max > 0 && seg_max < d->max_segs)
+        d->max_segs = seg_max;
+    }
+
+  if (!setup_queue (d))
+    {
+      outb (reg_status (d), STATUS_FAILED);
+      return false;
+    }
+
+  /* Devices on the same interrupt line share one handler. */
+  if (!irq_registered[line])
+    {
+      intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+      irq_registered[line] = true;
+    }
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  capacity = inl (reg_config (d) + CONFIG_CAPACITY)
+             | (uint64_t) inl (reg_config (d) + CONFIG_CAPACITY + 4) << 32;
+  if (capacity > (block_sector_t) -1)
+    capacity = (block_sector_t) -1;
+  snprintf (extra_info, sizeof extra_info,
+            "virtio, PCI %02x:%02x.%x, %zu requests in flight",
+            d->dev.bus, d->dev.slot, d->dev.func, d->slot_cnt);
+  d->block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                             &virtio_blk_operations, d);
+  return true;
+}
+
+/* Allocates disk D's request ring and hands it to the device.
+   Returns true if successful, false on failure. */
+static bool
+setup_queue (struct virtio_disk *d)
+{
+  size_t n, used_ofs, page_cnt, i;
+  uint8_t *ring;
+
+  outw (reg_queue_select (d), 0);
+  n = inw (reg_queue_size (d));
+  if (n == 0 || (n & (n - 1)) != 0 || n > MAX_QUEUE_SIZE
+      || n < DESC_PER_SLOT)
+    {
+      printf ("%s: unsupported queue size %zu, ignoring\n", d->name, n);
+      return false;
+    }
+
+  used_ofs = ROUND_UP (n * sizeof (struct vring_desc)
+                       + sizeof (struct vring_avail) + (n + 1) * 2,
+                       VRING_ALIGN);
+  page_cnt = (used_ofs + ROUND_UP (sizeof (struct vring_used)
+                                   + n * sizeof (struct vring_used_elem) + 2,
+                                   VRING_ALIGN)) / PGSIZE;
+  ring = palloc_get_multiple (PAL_ZERO, page_cnt);
+  if (ring == NULL)
+    {
+      printf ("%s: out of memory for request ring, ignoring\n", d->name);
+      return false;
+    }
+
+  d->queue_size = n;
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + n * sizeof (struct vring_desc));
+  d->used = (struct vring_used *) (ring + used_ofs);
+  d->last_used = 0;
+  d->slot_cnt = n / DESC_PER_SLOT < MAX_SLOTS ? n / DESC_PER_SLOT : MAX_SLOTS;
+  for (i = 0; i < d->slot_cnt; i++)
+    d->slots[i].req = NULL;
+  d->pending = NULL;
+
+  outl (reg_queue_pfn (d), vtop (ring) / VRING_ALIGN);
+  return true;
+}
+
+/* Queues REQ, a request for disk D, and hands it to the device at
+   once if a request slot is free.  The interrupt handler starts
+   it later otherwise. */
+static void
+virtio_blk_submit (void *d_, struct block_request *req)
+{
+  struct virtio_disk *d = d_;
+  enum intr_level old_level = intr_disable ();
+
+  block_enqueue (d->block, req);
+  start_requests (d);
+  intr_set_level (old_level);
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    .submit = virtio_blk_submit
+  };
+
+/* Fills disk D's free request slots from its queue and notifies
+   the device if any were filled.  Interrupts must be off. */
+static void
+start_requests (struct virtio_disk *d)
+{
+  bool issued = false;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < d->slot_cnt; i++)
+    if (d->slots[i].req == NULL)
+      {
+        if (d->pending == NULL)
+          d->pending = block_dequeue (d->block);
+        if (d->pending == NULL)
+          break;
+        issue_request (d, i);
+        issued = true;
+      }
+
+  if (issued)
+    {
+      /* The device must see the new ring entries before it is
+         told about them. */
+      barrier ();
+      outw (reg_queue_notify (d), 0);
+    }
+}
+
+/* Describes the first up to D->max_segs requests of disk D's
+   pending chain, which are for consecutive sectors, in free slot
+   SLOT_IDX and offers them to the device as one request.  The
+   block layer only passes buffers in kernel memory, which is
+   physically contiguous, so each buffer takes one descriptor. */
+static void
+issue_request (struct virtio_disk *d, size_t slot_idx)
+{
+  struct slot *s = &d->slots[slot_idx];
+  uint16_t head = slot_idx * DESC_PER_SLOT;
+  struct vring_desc *desc = d->desc + head;
+  struct block_request *req, *last = NULL;
+  size_t n = 0;
+
+  s->req = d->pending;
+  s->hdr.type = s->req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  s->hdr.reserved = 0;
+  s->hdr.sector = s->req->dev_sector;
+  s->status = 0xff;
+
+  desc[0].addr = vtop (&s->hdr);
+  desc[0].len = sizeof s->hdr;
+  desc[0].flags = VRING_DESC_F_NEXT;
+  desc[0].next = head + 1;
+  for (req = s->req; req != NULL && n < d->max_segs; req = req->chain)
+    {
+      n++;
+      desc[n].addr = vtop (req->buffer);
+      desc[n].len = req->cnt * BLOCK_SECTOR_SIZE;
+      desc[n].flags = (VRING_DESC_F_NEXT
+                       | (req->write ? 0 : VRING_DESC_F_WRITE));
+      desc[n].next = head + n + 1;
+      last = req;
+    }
+  desc[n + 1].addr = vtop (&s->status);
+  desc[n + 1].len = sizeof s->status;
+  desc[n + 1].flags = VRING_DESC_F_WRITE;
+  desc[n + 1].next = 0;
+
+  /* The rest of the chain waits for another slot. */
+  d->pending = last->chain;
+  last->chain = NULL;
+
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+}
+
+/* Completes the requests that disk D has finished and refills
+   their slots.  Panics if one of them failed.  Interrupts must be
+   off. */
+static void
+complete_requests (struct virtio_disk *d)
+{
+  while (d->last_used != d->used->idx)
+    {
+      struct slot *s;
+      struct block_request *req;
+
+      barrier ();
+      s = &d->slots[d->used->ring[d->last_used % d->queue_size].id
+                    / DESC_PER_SLOT];
+      req = s->req;
+      ASSERT (req != NULL);
+      if (s->status != VIRTIO_BLK_S_OK)
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+               req->write ? "write" : "read", req->dev_sector);
+
+      s->req = NULL;
+      d->last_used++;
+      while (req != NULL)
+        {
+          struct block_request *next = req->chain;
+          block_request_done (req);
+          req = next;
+        }
+    }
+  start_requests (d);
+}
+
+/* Virtio block interrupt handler.  Reading a disk's interrupt
+   status register acknowledges its interrupt. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct virtio_disk *d = &disks[i];
+      if (f->vec_no == d->irq && (inb (reg_isr (d)) & ISR_QUEUE))
+        complete_requests (d);
+    }
+}
@@ -0,0 +1,56 @@
+/* iostat.c
+
+   Prints I/O statistics for each block device named on the
+   command line, or for the file system and swap devices if none
+   is named. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+static void print_op (const char *name, const struct block_op_stats *);
+
+int
+main (int argc, char *argv[])
+{
+  static const char *defaults[] = {"filesys", "swap"};
+  const char **devices = (const char **) argv + 1;
+  int device_cnt = argc - 1;
+  bool success = true;
+  int i;
+
+  if (device_cnt == 0)
+    {
+      devices = defaults;
+      device_cnt = 2;
+    }
+
+  for (i = 0; i < device_cnt; i++)
+    {
+      struct block_stats s;
+
+      if (!blockstat (devices[i], &s))
+        {
+          printf ("%s: no such block device\n", devices[i]);
+          success = false;
+          continue;
+        }
+      printf ("%s:\n", devices[i]);
+      print_op ("read", &s.read);
+      print_op ("write", &s.write);
+      printf ("  queue depth %u, max %u, busy %llu%%\n", s.depth,
+              s.max_depth, s.elapsed ? s.busy * 100 / s.elapsed : 0);
+      printf ("  weight %u, throttled %llu times\n", s.weight, s.throttled);
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Prints the statistics in OP for requests of direction NAME. */
+static void
+print_op (const char *name, const struct block_op_stats *op)
+{
+  printf ("  %s: %llu requests, %llu bytes", name, op->requests, op->bytes);
+  if (op->requests > 0)
+    printf (", latency avg %llu max %llu cycles",
+            op->latency / op->requests, op->max_latency);
+  printf ("\n");
+}
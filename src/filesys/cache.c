@@ -1,15 +1,16 @@
 #include <debug.h>
+#include <stdlib.h>
 #include <string.h>
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/synch.h"
 
-#define BUFFER_CACHE_SIZE 64
-
 struct buffer_cache_entry{
     bool valid;
     bool dirty;
     bool second_time;   //for clock algorithm
+    bool journaled;     //image is in the running journal transaction
     block_sector_t sector;
     uint8_t data[BLOCK_SECTOR_SIZE];
 };
@@ -20,6 +21,8 @@ static struct buffer_cache_entry cache[BUFFER_CACHE_SIZE];
 /* For synchronizing. Only one operation with buffer at the same time*/
 static struct lock buffer_cache_lock;
 
+static struct buffer_cache_entry* buffer_cache_lookup(block_sector_t sector);
+
 /* Init the buffer cache when the file sysytem init*/
 void
 buffer_cache_init(void)
@@ -29,6 +32,7 @@ buffer_cache_init(void)
         cache[i].valid = false;
         cache[i].dirty = false;
         cache[i].second_time = false;
+        cache[i].journaled = false;
     }
 }
 
@@ -37,11 +41,86 @@ buffer_cache_init(void)
 void
 buffer_cache_close(void)
 {
-    lock_acquire(&buffer_cache_lock);
+    buffer_cache_flush();
+}
+
+/* Orders cache entries by sector, for qsort()*/
+static int
+compare_entry_sector(const void *a_, const void *b_)
+{
+    const struct buffer_cache_entry *a = *(struct buffer_cache_entry * const *) a_;
+    const struct buffer_cache_entry *b = *(struct buffer_cache_entry * const *) b_;
+    return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Collect dirty entries into ENTRIES sorted by sector, return the count*/
+static size_t
+collect_dirty(struct buffer_cache_entry **entries)
+{
+    size_t cnt = 0;
+    ASSERT(lock_held_by_current_thread(&buffer_cache_lock));
     for(size_t i = 0; i < BUFFER_CACHE_SIZE; i++){
-        if(cache[i].valid == true && cache[i].dirty == true){
-            block_write(fs_device, cache[i].sector, cache[i].data);
-        }
+        /* Journaled entries may only reach their home sector
+           through a journal checkpoint. */
+        if(cache[i].valid == true && cache[i].dirty == true
+           && cache[i].journaled == false)
+            entries[cnt++] = &cache[i];
+    }
+    qsort(entries, cnt, sizeof *entries, compare_entry_sector);
+    return cnt;
+}
+
+/* Report which sectors are dirty, sorted*/
+size_t
+buffer_cache_dirty_sectors(block_sector_t *sectors)
+{
+    struct buffer_cache_entry *entries[BUFFER_CACHE_SIZE];
+    lock_acquire(&buffer_cache_lock);
+    size_t cnt = collect_dirty(entries);
+    for(size_t i = 0; i < cnt; i++)
+        sectors[i] = entries[i]->sector;
+    lock_release(&buffer_cache_lock);
+    return cnt;
+}
+
+/* Write back one sector if it is dirty*/
+void
+buffer_cache_flush_sector(block_sector_t sector)
+{
+    lock_acquire(&buffer_cache_lock);
+    struct buffer_cache_entry* entry = buffer_cache_lookup(sector);
+    if(entry != NULL && entry->dirty == true && entry->journaled == false){
+        block_write(fs_device, entry->sector, entry->data);
+        entry->dirty = false;
+    }
+    lock_release(&buffer_cache_lock);
+}
+
+/* Write back all dirty entries, in sector order to minimize seeking.
+   Adjacent sectors are combined into multi-sector writes*/
+void
+buffer_cache_flush(void)
+{
+    struct buffer_cache_entry *entries[BUFFER_CACHE_SIZE];
+    lock_acquire(&buffer_cache_lock);
+    size_t cnt = collect_dirty(entries);
+    for(size_t i = 0; i < cnt; i++){
+        block_write_combine(fs_device, entries[i]->sector, 1, entries[i]->data);
+        entries[i]->dirty = false;
+    }
+    block_flush(fs_device);
+    lock_release(&buffer_cache_lock);
+}
+
+/* Drop the entry for a freed sector, dirty or not*/
+void
+buffer_cache_discard(block_sector_t sector)
+{
+    lock_acquire(&buffer_cache_lock);
+    struct buffer_cache_entry* entry = buffer_cache_lookup(sector);
+    if(entry != NULL && entry->journaled == false){
+        entry->valid = false;
+        entry->dirty = false;
     }
     lock_release(&buffer_cache_lock);
 }
@@ -72,10 +151,15 @@ static struct buffer_cache_entry* buffer_cache_evict(void){
     }
 
     ASSERT(cache[pointer].valid);
-    if(cache[pointer].dirty == true){
-        block_write(fs_device, cache[pointer].sector, cache[pointer].data);
+    /* A journaled entry's image is kept by the journal, which will
+       write it home at checkpoint, so it can simply be dropped.
+       Write-combined, so that evicting neighbors costs one write. */
+    if(cache[pointer].dirty == true && cache[pointer].journaled == false){
+        block_write_combine(fs_device, cache[pointer].sector, 1,
+                            cache[pointer].data);
     }
     cache[pointer].valid = false;
+    cache[pointer].journaled = false;
     return &(cache[pointer]);
 }
 
@@ -91,7 +175,8 @@ buffer_cache_read(block_sector_t sector, void *target)
         target_entry->dirty = false;
 //        target_entry->second_time = true;
         target_entry->sector = sector;
-        block_read(fs_device, sector, target_entry->data);
+        if(!journal_read(sector, target_entry->data))
+            block_read(fs_device, sector, target_entry->data);
     }
     target_entry->second_time = true;
     memcpy(target, target_entry->data, BLOCK_SECTOR_SIZE);
@@ -101,11 +186,62 @@ buffer_cache_read(block_sector_t sector, void *target)
 }
 
 
-/* Try to write data from source to buffer*/
+/* Read a run of sectors, bypassing the cache for the ones not in it.
+   Sectors only the disk has are read with one command per run*/
 void
-buffer_cache_write(block_sector_t sector, const void *source)
+buffer_cache_read_multiple(block_sector_t sector, size_t cnt, void *target)
+{
+    uint8_t *dst = target;
+    size_t i = 0;
+    lock_acquire(&buffer_cache_lock);
+    while(i < cnt){
+        struct buffer_cache_entry* entry = buffer_cache_lookup(sector + i);
+        if(entry != NULL){
+            entry->second_time = true;
+            memcpy(dst + i * BLOCK_SECTOR_SIZE, entry->data, BLOCK_SECTOR_SIZE);
+            i++;
+        }
+        else if(journal_read(sector + i, dst + i * BLOCK_SECTOR_SIZE))
+            i++;
+        else{
+            size_t run = 1;
+            while(i + run < cnt && buffer_cache_lookup(sector + i + run) == NULL
+                  && !journal_read(sector + i + run,
+                                   dst + (i + run) * BLOCK_SECTOR_SIZE))
+                run++;
+            block_read_multiple(fs_device, sector + i, run,
+                                dst + i * BLOCK_SECTOR_SIZE);
+            i += run;
+        }
+    }
+    lock_release(&buffer_cache_lock);
+}
+
+/* Write a run of data sectors through to disk, bypassing the cache*/
+void
+buffer_cache_write_multiple(block_sector_t sector, size_t cnt, const void *source)
 {
+    const uint8_t *src = source;
+    for(size_t i = 0; i < cnt; i++)
+        journal_revoke(sector + i);
     lock_acquire(&buffer_cache_lock);
+    for(size_t i = 0; i < cnt; i++, src += BLOCK_SECTOR_SIZE){
+        struct buffer_cache_entry* entry = buffer_cache_lookup(sector + i);
+        if(entry != NULL){
+            memcpy(entry->data, src, BLOCK_SECTOR_SIZE);
+            entry->dirty = false;
+            entry->journaled = false;
+        }
+    }
+    block_write_multiple(fs_device, sector, cnt, source);
+    lock_release(&buffer_cache_lock);
+}
+
+/* Find or load the entry for SECTOR and overwrite it from SOURCE*/
+static struct buffer_cache_entry*
+buffer_cache_store(block_sector_t sector, const void *source)
+{
+    ASSERT(lock_held_by_current_thread(&buffer_cache_lock));
     struct buffer_cache_entry* source_entry = buffer_cache_lookup(sector);
     if(source_entry == NULL){
         source_entry = buffer_cache_evict();
@@ -113,11 +249,44 @@ buffer_cache_write(block_sector_t sector, const void *source)
 //        source_entry->dirty = false;
 //        source_entry->second_time = true;
         source_entry->sector = sector;
-        block_read(fs_device, sector, source_entry->data);
+        if(!journal_read(sector, source_entry->data))
+            block_read(fs_device, sector, source_entry->data);
     }
     source_entry->second_time = true;
     source_entry->dirty = true;
     memcpy(source_entry->data, source, BLOCK_SECTOR_SIZE);
+    return source_entry;
+}
 
+/* Try to write data from source to buffer*/
+void
+buffer_cache_write(block_sector_t sector, const void *source)
+{
+    /* Plain data overrides any metadata image of a reused sector. */
+    journal_revoke(sector);
+    lock_acquire(&buffer_cache_lock);
+    buffer_cache_store(sector, source)->journaled = false;
+    lock_release(&buffer_cache_lock);
+}
+
+/* Write metadata to buffer; the caller has logged it in the journal*/
+void
+buffer_cache_write_journaled(block_sector_t sector, const void *source)
+{
+    lock_acquire(&buffer_cache_lock);
+    buffer_cache_store(sector, source)->journaled = true;
+    lock_release(&buffer_cache_lock);
+}
+
+/* The journal wrote SECTOR home: its cached copy is clean again*/
+void
+buffer_cache_journal_done(block_sector_t sector)
+{
+    lock_acquire(&buffer_cache_lock);
+    struct buffer_cache_entry* entry = buffer_cache_lookup(sector);
+    if(entry != NULL && entry->journaled == true){
+        entry->journaled = false;
+        entry->dirty = false;
+    }
     lock_release(&buffer_cache_lock);
 }
@@ -1,8 +1,11 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <stddef.h>
 #include "devices/block.h"
 
+/* Number of sectors held by the buffer cache. */
+#define BUFFER_CACHE_SIZE 64
 
 void buffer_cache_init (void);
 void buffer_cache_close (void);
@@ -19,4 +22,57 @@ void buffer_cache_read (block_sector_t sector, void *target);
  */
 void buffer_cache_write (block_sector_t sector, const void *source);
 
+/**
+ * Reads the 'cnt' consecutive sectors starting at 'sector' into
+ * `target`.  Cached sectors are copied from the cache, the others
+ * are read straight from disk without filling the cache.
+ */
+void buffer_cache_read_multiple (block_sector_t sector, size_t cnt,
+                                 void *target);
+
+/**
+ * Writes the 'cnt' consecutive sectors starting at 'sector' from
+ * `source` straight to disk, updating any cached copies.  For file
+ * data only: the sectors must not be journaled metadata.
+ */
+void buffer_cache_write_multiple (block_sector_t sector, size_t cnt,
+                                  const void *source);
+
+/**
+ * As buffer_cache_write(), for a metadata sector whose new contents
+ * the caller has logged in the journal.  The entry is never written
+ * home by the cache itself; see journal_write().
+ */
+void buffer_cache_write_journaled (block_sector_t sector,
+                                   const void *source);
+
+/**
+ * Called by the journal after writing 'sector' home at checkpoint.
+ */
+void buffer_cache_journal_done (block_sector_t sector);
+
+/**
+ * Forgets the cached contents of 'sector', which has been freed,
+ * without writing them back.
+ */
+void buffer_cache_discard (block_sector_t sector);
+
+/**
+ * Stores the sectors of all dirty entries into `sectors`, which must
+ * have room for BUFFER_CACHE_SIZE entries, in ascending order, and
+ * returns how many there are.
+ */
+size_t buffer_cache_dirty_sectors (block_sector_t *sectors);
+
+/**
+ * Writes back the entry for 'sector' if it is cached and dirty.
+ * The entry stays cached, now clean.
+ */
+void buffer_cache_flush_sector (block_sector_t sector);
+
+/**
+ * Writes back every dirty entry, in ascending sector order.
+ */
+void buffer_cache_flush (void);
+
 #endif
@@ -0,0 +1,214 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Number of (parent, name) pairs remembered. */
+#define DCACHE_SIZE 256
+
+/* A cached directory entry.
+   A negative entry records that PARENT has no entry called NAME. */
+struct dcache_entry
+  {
+    struct hash_elem hash_elem;         /* Element in dcache_hash. */
+    struct list_elem lru_elem;          /* Element in lru_list or free_list. */
+    block_sector_t parent;              /* Sector of the parent directory. */
+    block_sector_t sector;              /* Inode sector, if not negative. */
+    bool negative;                      /* True if NAME does not exist. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* All the entries, allocated once. */
+static struct dcache_entry entries[DCACHE_SIZE];
+
+/* Entries in use, indexed by (parent, name). */
+static struct hash dcache_hash;
+
+/* Entries in use, least recently used at the front. */
+static struct list lru_list;
+
+/* Entries not in use. */
+static struct list free_list;
+
+/* Protects all of the above. */
+static struct lock dcache_lock;
+
+static hash_hash_func dcache_hash_func;
+static hash_less_func dcache_less_func;
+
+/* Initializes the directory-entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  lock_init (&dcache_lock);
+  hash_init (&dcache_hash, dcache_hash_func, dcache_less_func, NULL);
+  list_init (&lru_list);
+  list_init (&free_list);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back (&free_list, &entries[i].lru_elem);
+}
+
+/* Returns the entry for (PARENT, NAME), or a null pointer if
+   there is none.  The cache lock must be held. */
+static struct dcache_entry *
+find (block_sector_t parent, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache_hash, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Unlinks entry E and returns it to the free list.
+   The cache lock must be held. */
+static void
+release (struct dcache_entry *e)
+{
+  hash_delete (&dcache_hash, &e->hash_elem);
+  list_remove (&e->lru_elem);
+  list_push_back (&free_list, &e->lru_elem);
+}
+
+/* Looks up NAME in the directory whose inode is in sector
+   PARENT.  On a hit, stores the inode sector in *SECTORP. */
+enum dcache_result
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp)
+{
+  enum dcache_result result = DCACHE_MISS;
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return DCACHE_MISS;
+
+  lock_acquire (&dcache_lock);
+  e = find (parent, name);
+  if (e != NULL)
+    {
+      /* Move to the most recently used end. */
+      list_remove (&e->lru_elem);
+      list_push_back (&lru_list, &e->lru_elem);
+      if (e->negative)
+        result = DCACHE_NEGATIVE;
+      else
+        {
+          *sectorp = e->sector;
+          result = DCACHE_HIT;
+        }
+    }
+  lock_release (&dcache_lock);
+  return result;
+}
+
+/* Records (PARENT, NAME) as SECTOR, or as absent if NEGATIVE,
+   replacing any previous entry and evicting the least recently
+   used entry if the cache is full. */
+static void
+insert (block_sector_t parent, const char *name, block_sector_t sector,
+        bool negative)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  e = find (parent, name);
+  if (e != NULL)
+    release (e);
+
+  if (list_empty (&free_list))
+    release (list_entry (list_front (&lru_list),
+                         struct dcache_entry, lru_elem));
+  e = list_entry (list_pop_front (&free_list), struct dcache_entry, lru_elem);
+
+  e->parent = parent;
+  e->sector = sector;
+  e->negative = negative;
+  strlcpy (e->name, name, sizeof e->name);
+  hash_insert (&dcache_hash, &e->hash_elem);
+  list_push_back (&lru_list, &e->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Records that NAME in directory PARENT has its inode in
+   SECTOR. */
+void
+dcache_insert (block_sector_t parent, const char *name, block_sector_t sector)
+{
+  insert (parent, name, sector, false);
+}
+
+/* Records that directory PARENT has no entry called NAME. */
+void
+dcache_insert_negative (block_sector_t parent, const char *name)
+{
+  insert (parent, name, 0, true);
+}
+
+/* Forgets anything known about NAME in directory PARENT.
+   Must be called whenever the entry is added or removed. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  e = find (parent, name);
+  if (e != NULL)
+    release (e);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every entry whose parent is the directory in sector
+   PARENT.  Called when that directory is removed, so that stale
+   entries cannot be found if the sector is later reused. */
+void
+dcache_purge_dir (block_sector_t parent)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru_list); e != list_end (&lru_list); e = next)
+    {
+      struct dcache_entry *de = list_entry (e, struct dcache_entry, lru_elem);
+      next = list_next (e);
+      if (de->parent == parent)
+        release (de);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Hashes the (parent, name) key of a cache entry. */
+static unsigned
+dcache_hash_func (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+  return hash_string (e->name) ^ hash_int (e->parent);
+}
+
+/* Orders cache entries by parent sector, then by name. */
+static bool
+dcache_less_func (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
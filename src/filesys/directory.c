@@ -1,12 +1,18 @@
 #include "filesys/directory.h"
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
 
+/* A directory is compacted once it has at least this many slots
+   and more of them are free than in use. */
+#define DIR_COMPACT_MIN_SLOTS 32
+
 /* A directory. */
 struct dir 
   {
@@ -14,44 +20,64 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
+/* A single directory entry.  Its 20-byte layout is on disk, so
+   the type of entry is kept in spare bits of IN_USE rather than in
+   a field of its own. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
+    uint8_t in_use;                     /* DIR_ENTRY_* bits, 0 if free. */
   };
 
-/* 
-input path and this function will fill directory and filename
-*/
-void 
-parse_path_name(const char *path, char *directory, char *filename)
+/* Bits of a struct dir_entry's IN_USE. */
+#define DIR_ENTRY_USED 0x01             /* In use: always set if any is. */
+#define DIR_ENTRY_TYPED 0x02            /* DIR_ENTRY_DIR is valid. */
+#define DIR_ENTRY_DIR 0x04              /* Names a directory. */
+
+/* Returns true if in-use entry E names a directory.  Entries
+   written before the type was recorded are looked up in their
+   inodes. */
+static bool
+entry_is_dir (const struct dir_entry *e)
 {
-  int l = strlen(path);
-  char *s = (char *) malloc(sizeof(char) * (l + 1));
-  memcpy(s, path, sizeof(char) * (l + 1));
+  struct inode *inode;
+  bool is_dir;
+
+  if (e->in_use & DIR_ENTRY_TYPED)
+    return (e->in_use & DIR_ENTRY_DIR) != 0;
+  inode = inode_open (e->inode_sector);
+  is_dir = inode != NULL && inode_dir (inode);
+  inode_close (inode);
+  return is_dir;
+}
 
-  char *dir = directory;
-  if (l > 0 && path[0] == '/') 
-    if (dir) *dir++ = '/';
+/* Extracts the next component of the path at *SRCP into NAME
+   and advances *SRCP past it, skipping any run of slashes.
+   Works in place on the path, without copying or modifying it.
+   Returns 1 if a component was extracted, 0 at the end of the
+   path, or -1 if the component is longer than NAME_MAX. */
+int
+dir_path_next (const char **srcp, char name[NAME_MAX + 1])
+{
+  const char *src = *srcp;
+  char *dst = name;
 
-  char *token, *save_ptr, *last_token = "";
-  for (token = strtok_r(s, "/", &save_ptr); token != NULL; token = strtok_r(NULL, "/", &save_ptr)) 
-  {
-    int len = strlen(last_token);
-    if (dir && len > 0) 
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  while (*src != '/' && *src != '\0')
     {
-      memcpy(dir, last_token, sizeof(char) * len);
-      dir[len] = '/';
-      dir += len + 1; 
+      if (dst >= name + NAME_MAX)
+        return -1;
+      *dst++ = *src++;
     }
-    last_token = token;
-  }
+  *dst = '\0';
 
-  if (dir) *dir = '\0';
-  memcpy(filename, last_token, sizeof(char) * (strlen(last_token) + 1));
-  free(s);
+  *srcp = src;
+  return 1;
 }
 
 /* Creates a directory with space for ENTRY_CNT entries in the
@@ -101,50 +127,81 @@ dir_open_root (void)
   return dir_open (inode_open (ROOT_DIR_SECTOR));
 }
 
+/* Resolves every component of PATH except the last, relative
+   to the root directory if PATH is absolute or the current
+   thread's working directory otherwise, in a single pass over
+   PATH.  Stores the last component in NAME, or the empty string
+   if PATH names no component (e.g. "/"), and returns its
+   directory, which the caller must close.
+   Returns a null pointer if a component does not exist, is not a
+   directory, or is too long, or if the directory was removed. */
 struct dir *
-dir_open_path (const char *path) 
+dir_open_parent (const char *path, char name[NAME_MAX + 1])
 {
-  int len = strlen(path);
-  char s[len + 1];
-  strlcpy(s, path, len + 1);
-
-  struct dir *cur_dir;
-  if (path[0] == '/') 
-    cur_dir = dir_open_root();
-  else 
-  {
-    struct thread *t = thread_current();
-    if (t->cwd == NULL) 
-      cur_dir = dir_open_root();
-    else 
-      cur_dir = dir_reopen(t->cwd);
-  }
-  char *token, *p;
-  for (token = strtok_r(s, "/", &p); token != NULL;
-       token = strtok_r(NULL, "/", &p))
-  {
-    struct inode *inode = NULL;
-    if(! dir_lookup(cur_dir, token, &inode)) {
-      dir_close(cur_dir);
-      return NULL; // such directory not exist
+  struct thread *t = thread_current ();
+  struct inode *cur;
+  char next[NAME_MAX + 1];
+  int r;
+
+  if (path[0] == '/' || t->cwd == NULL)
+    cur = inode_open (ROOT_DIR_SECTOR);
+  else
+    cur = inode_reopen (dir_get_inode (t->cwd));
+
+  name[0] = '\0';
+  while ((r = dir_path_next (&path, next)) > 0)
+    {
+      /* NAME holds the previous component: step into it. */
+      if (name[0] != '\0')
+        {
+          struct dir parent = { cur, 0 };
+          struct inode *child;
+          bool found = cur != NULL && dir_lookup (&parent, name, &child);
+
+          inode_close (cur);
+          if (!found)
+            return NULL;
+          cur = child;
+          if (!inode_dir (cur))
+            r = -1;
+        }
+      if (r < 0)
+        break;
+      strlcpy (name, next, NAME_MAX + 1);
     }
 
-    struct dir *next = dir_open(inode);
-    if(next == NULL) {
-      dir_close(cur_dir);
+  if (r < 0 || cur == NULL || inode_is_removed (cur))
+    {
+      inode_close (cur);
       return NULL;
     }
-    dir_close(cur_dir);
-    cur_dir = next;
-  }
+  return dir_open (cur);
+}
+
+/* Opens the directory named by PATH, as resolved by
+   dir_open_parent().  Returns a null pointer if PATH does not
+   name an existing, non-removed directory. */
+struct dir *
+dir_open_path (const char *path)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir = dir_open_parent (path, name);
+  struct inode *inode;
+  bool found;
 
-  // prevent from opening removed directories
-  if (inode_is_removed (dir_get_inode(cur_dir))) {
-    dir_close(cur_dir);
+  if (dir == NULL || name[0] == '\0')
+    return dir;
+
+  found = dir_lookup (dir, name, &inode);
+  dir_close (dir);
+  if (!found)
     return NULL;
-  }
- // printf("--success open path %s--\n", path);
-  return cur_dir;
+  if (!inode_dir (inode) || inode_is_removed (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
+  return dir_open (inode);
 }
 
 /* Opens and returns a new directory for the same inode as DIR.
@@ -218,16 +275,43 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (name != NULL);
 
   if (strcmp(name, ".") == 0) 
-    *inode = inode_open(dir -> inode);
+    *inode = inode_reopen (dir->inode);
   else if (strcmp(name, "..") == 0) 
   {
     inode_read_at(dir->inode, &e, sizeof e, 0);
     *inode = inode_open(e.inode_sector);
   } 
-  else if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
   else
-    *inode = NULL;
+    {
+      block_sector_t parent = inode_get_inumber (dir->inode);
+      block_sector_t sector;
+
+      switch (dcache_lookup (parent, name, &sector))
+        {
+        case DCACHE_HIT:
+          *inode = inode_open (sector);
+          break;
+        case DCACHE_NEGATIVE:
+          *inode = NULL;
+          break;
+        default:
+          /* Don't populate the cache for a removed directory,
+             whose sector may be reused. */
+          if (lookup (dir, name, &e, NULL))
+            {
+              if (!inode_is_removed (dir->inode))
+                dcache_insert (parent, name, e.inode_sector);
+              *inode = inode_open (e.inode_sector);
+            }
+          else
+            {
+              if (!inode_is_removed (dir->inode))
+                dcache_insert_negative (parent, name);
+              *inode = NULL;
+            }
+          break;
+        }
+    }
 
   return *inode != NULL;
 }
@@ -286,15 +370,20 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
       break;
 
   /* Write slot. */
-  e.in_use = true;
+  e.in_use = (DIR_ENTRY_USED | DIR_ENTRY_TYPED
+              | (is_dir ? DIR_ENTRY_DIR : 0));
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
 
  done:
   //printf("dir add %s result %d\n", name, success);
   return success;
 }
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
@@ -312,6 +401,40 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   return false;
 }
 
+/* Reads up to CNT in-use entries from DIR, starting at its
+   current position, into ENTRIES, and advances the position past
+   them.  Reads as many whole entries as fit in a sector, 25 of
+   them, per inode access rather than one entry at a time.
+   Returns the number of entries
+   stored, which is 0 once the directory is exhausted. */
+size_t
+dir_readdir_many (struct dir *dir, struct dirent *entries, size_t cnt)
+{
+  struct dir_entry buf[BLOCK_SECTOR_SIZE / sizeof (struct dir_entry)];
+  size_t n = 0;
+
+  while (n < cnt)
+    {
+      off_t bytes = inode_read_at (dir->inode, buf, sizeof buf, dir->pos);
+      size_t i, avail = bytes / sizeof *buf;
+
+      if (avail == 0)
+        break;
+      for (i = 0; i < avail && n < cnt; i++)
+        {
+          dir->pos += sizeof *buf;
+          if (buf[i].in_use)
+            {
+              entries[n].inumber = buf[i].inode_sector;
+              entries[n].is_dir = entry_is_dir (&buf[i]);
+              strlcpy (entries[n].name, buf[i].name, sizeof entries[n].name);
+              n++;
+            }
+        }
+    }
+  return n;
+}
+
 bool 
 dir_isempty(struct dir *dir) 
 {
@@ -325,6 +448,86 @@ dir_isempty(struct dir *dir)
   return true;
 }
 
+/* As lookup(), but always scans all of DIR after slot 0, which
+   holds the parent pointer, many entries per inode access, and
+   stores in *SLOTS the number of slots it found and in *LIVE the
+   number of those in use, for dir_maybe_compact(). */
+static bool
+lookup_counting (const struct dir *dir, const char *name,
+                 struct dir_entry *ep, off_t *ofsp,
+                 size_t *slots, size_t *live)
+{
+  struct dir_entry buf[BLOCK_SECTOR_SIZE / sizeof (struct dir_entry)];
+  bool found = false;
+  off_t ofs;
+
+  *slots = *live = 0;
+  for (ofs = sizeof *buf; ; )
+    {
+      off_t bytes = inode_read_at (dir->inode, buf, sizeof buf, ofs);
+      size_t i, n = bytes / sizeof *buf;
+      if (n == 0)
+        break;
+      for (i = 0; i < n; i++, ofs += sizeof *buf)
+        if (buf[i].in_use)
+          {
+            (*live)++;
+            if (!found && !strcmp (name, buf[i].name))
+              {
+                found = true;
+                *ep = buf[i];
+                *ofsp = ofs;
+              }
+          }
+      *slots += n;
+    }
+  return found;
+}
+
+/* Rewrites the in-use entries of DIR densely at the front of the
+   directory, then truncates the directory inode after the last
+   of them, if the directory has grown large and is mostly free
+   slots: SLOTS slots after slot 0, of which LIVE are in use, as
+   counted by lookup_counting() in the scan that found the entry
+   just removed.  Slot 0 holds the parent pointer and stays in
+   place.
+
+   Moving entries would make concurrent readdir positions skip or
+   repeat names, so nothing is done while anyone besides DIR has
+   the directory open. */
+static void
+dir_maybe_compact (struct dir *dir, size_t slots, size_t live)
+{
+  struct dir_entry buf[BLOCK_SECTOR_SIZE / sizeof (struct dir_entry)];
+  off_t rd, wr;
+
+  if (inode_open_cnt (dir->inode) > 1)
+    return;
+  if (slots < DIR_COMPACT_MIN_SLOTS || slots - live <= live)
+    return;
+
+  /* Slide live entries down.  The write position never passes
+     the read position, so nothing is overwritten before it has
+     been read. */
+  for (rd = wr = sizeof *buf; ; )
+    {
+      off_t bytes = inode_read_at (dir->inode, buf, sizeof buf, rd);
+      size_t i, n = bytes / sizeof *buf;
+      if (n == 0)
+        break;
+      for (i = 0; i < n; i++, rd += sizeof *buf)
+        if (buf[i].in_use)
+          {
+            if (wr != rd
+                && inode_write_at (dir->inode, &buf[i], sizeof *buf, wr)
+                   != sizeof *buf)
+              return;
+            wr += sizeof *buf;
+          }
+    }
+  inode_truncate (dir->inode, wr);
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
    which occurs only if there is no file with the given NAME. */
@@ -335,13 +538,15 @@ dir_remove (struct dir *dir, const char *name)
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
+  size_t slots, live;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  /* Find directory entry, counting live slots on the way so that
+     deciding whether to compact needs no second scan. */
+  if (!lookup_counting (dir, name, &e, &ofs, &slots, &live))
     goto done;
   //printf("success lookup\n");
   /* Open inode. */
@@ -352,7 +557,7 @@ dir_remove (struct dir *dir, const char *name)
   //delete directory
   if (inode_dir(inode)) 
   {
-    struct dir *dele = dir_open(inode);
+    struct dir *dele = dir_open(inode_reopen(inode));
     bool is_empty = dir_isempty(dele);
  ///   printf("isempty? %d\n",is_empty);
     dir_close(dele);
@@ -361,20 +566,19 @@ dir_remove (struct dir *dir, const char *name)
   }
 
   /* Erase directory entry. */
-  e.in_use = false;
+  e.in_use = 0;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (inode_dir (inode))
+    dcache_purge_dir (inode_get_inumber (inode));
 //  printf("success rewrite\n");
   /* Remove inode. */
   inode_remove (inode);
   success = true;
+  dir_maybe_compact (dir, slots, live - 1);
 
  done:
   inode_close (inode);
   return success;
 }
-
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
-
@@ -5,6 +5,8 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+struct dirent;
+
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
    After directories are implemented, this maximum length may be
@@ -16,14 +18,20 @@ struct inode;
 bool dir_create (block_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
+struct dir *dir_open_path (const char *path);
+struct dir *dir_open_parent (const char *path, char name[NAME_MAX + 1]);
 struct dir *dir_reopen (struct dir *);
 void dir_close (struct dir *);
 struct inode *dir_get_inode (struct dir *);
 
+/* Path names. */
+int dir_path_next (const char **srcp, char name[NAME_MAX + 1]);
+
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t, bool);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_readdir_many (struct dir *, struct dirent *, size_t cnt);
 
 #endif /* filesys/directory.h */
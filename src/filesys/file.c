@@ -9,6 +9,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool direct;                /* Bypass the buffer cache? */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +24,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->direct = false;
       return file;
     }
   else
@@ -68,7 +70,7 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = file_read_at (file, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,6 +83,8 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
+  if (file->direct)
+    return inode_read_direct (file->inode, buffer, size, file_ofs);
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -94,7 +98,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written = file_write_at (file, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -110,9 +114,75 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  if (file->direct)
+    return inode_write_direct (file->inode, buffer, size, file_ofs);
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, into DST at its current position, a sector at a time
+   through the buffer cache, so that the data never leaves the
+   kernel.  Advances both positions by the number of bytes copied,
+   which is less than SIZE if the end of SRC is reached or an
+   error occurs.  DST and SRC must not share an inode. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  off_t bytes_copied = 0;
+
+  ASSERT (dst != NULL);
+  ASSERT (src != NULL);
+
+  while (size > 0)
+    {
+      /* Keep reads of SRC sector-aligned after the first. */
+      off_t chunk_size = BLOCK_SECTOR_SIZE - src->pos % BLOCK_SECTOR_SIZE;
+      off_t n;
+
+      if (chunk_size > size)
+        chunk_size = size;
+      n = file_read_at (src, buffer, chunk_size, src->pos);
+      if (n <= 0)
+        break;
+      n = file_write_at (dst, buffer, n, dst->pos);
+      src->pos += n;
+      dst->pos += n;
+      bytes_copied += n;
+      size -= n;
+      if (n < chunk_size)
+        break;
+    }
+  return bytes_copied;
+}
+
+/* Sets whether whole sectors read from or written to FILE bypass
+   the buffer cache, moving straight between the caller's buffer
+   and the disk.  Partial sectors still go through the cache. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  file->direct = direct;
+}
+
+/* Writes any of FILE's data and metadata still held in the
+   buffer cache back to disk. */
+void
+file_sync (struct file *file)
+{
+  ASSERT (file != NULL);
+  inode_flush (file->inode);
+}
+
+/* Moves FILE's data into one contiguous extent on disk.
+   Returns true if successful, false otherwise. */
+bool
+file_defragment (struct file *file)
+{
+  ASSERT (file != NULL);
+  return inode_defragment (file->inode);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -16,6 +17,14 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
+
+/* Bypassing the buffer cache. */
+void file_set_direct (struct file *, bool);
+
+/* Durability. */
+void file_sync (struct file *);
+bool file_defragment (struct file *);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
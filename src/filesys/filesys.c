@@ -2,9 +2,14 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/lfs.h"
+#include "filesys/pagecache.h"
 #include "filesys/directory.h"
 
 /* Partition that contains the file system. */
@@ -13,9 +18,10 @@ struct block *fs_device;
 static void do_format (void);
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system, in log-structured
+   write mode if LOG_MODE is true. */
 void
-filesys_init (bool format) 
+filesys_init (bool format, bool log_mode) 
 {
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
@@ -25,10 +31,14 @@ filesys_init (bool format)
   free_map_init ();
 
   buffer_cache_init();
+  dcache_init ();
+  pagecache_init ();
+  journal_init (format);
   if (format) 
     do_format ();
 
   free_map_open ();
+  lfs_init (format, log_mode);
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -36,10 +46,22 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  lfs_flush ();
   free_map_close ();
   buffer_cache_close();
+  journal_commit ();
 }
 
+/* Writes every dirty sector in the buffer cache back to disk,
+   then commits the metadata journal. */
+void
+filesys_sync (void)
+{
+  lfs_flush ();
+  buffer_cache_flush ();
+  journal_commit ();
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -48,18 +70,61 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  char directory[strlen(name)];
-  char filename[strlen(name)];
-  parse_path_name(name, directory, filename);
-  struct dir *dir = dir_open_path(directory);
-
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size, 0)
-                  && dir_add (dir, filename, inode_sector, 0));
+  char filename[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_parent (name, filename);
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size, 0)
+             && dir_add (dir, filename, inode_sector, 0));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+/* Creates a file named NAME of SIZE bytes, whose data is one
+   physically contiguous extent, and stores the extent's first
+   sector in *FIRST.  The caller must write every data sector.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists, if SIZE is 0, or if
+   no free extent is long enough. */
+bool
+filesys_create_extent (const char *name, off_t size, block_sector_t *first)
+{
+  block_sector_t inode_sector = 0;
+  char filename[NAME_MAX + 1];
+  struct dir *dir;
+  struct inode *inode;
+  bool created = false;
+  bool success;
+
+  if (size <= 0)
+    return false;
+
+  journal_begin ();
+  dir = dir_open_parent (name, filename);
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && (created = inode_create_extent (inode_sector, size, first))
+             && dir_add (dir, filename, inode_sector, 0));
+  if (!success && created
+      && (inode = inode_open (inode_sector)) != NULL)
+    {
+      /* Closing the removed inode releases its extent, its index
+         blocks, and its own sector. */
+      inode_remove (inode);
+      inode_close (inode);
+    }
+  else if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -72,35 +137,28 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-/*  struct dir *dir = dir_open_root ();
+  char filename[NAME_MAX + 1];
+  struct dir *dir;
   struct inode *inode = NULL;
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+  if (name[0] == '\0')
+    return NULL;
+  dir = dir_open_parent (name, filename);
+  if (dir == NULL)
+    return NULL;
+
+  if (filename[0] != '\0')
+    dir_lookup (dir, filename, &inode);
+  else
+    inode = inode_reopen (dir_get_inode (dir));   /* e.g. "/" */
   dir_close (dir);
 
-  return file_open (inode);*/
-  int len = strlen(name);
-  if (len == 0) return NULL;
-  char directory[len+1], filename[len+1];
-  parse_path_name(name, directory, filename);
-  struct dir *dir = dir_open_path(directory);
-  struct inode *inode = NULL;
-  if (dir == NULL) return NULL;
-  if (strlen(filename) > 0)  //normal file
-  {
-    //printf("lookup filename %s\n", filename);
-   // printf("open file result %d\n", dir_lookup(dir, filename, &inode));
-    dir_lookup(dir, filename, &inode);
-    dir_close(dir);
-  }
-  else 
-  {
-    inode = dir_get_inode(dir);
-  }
-  if (inode == NULL || inode_is_removed(inode)) 
-    return NULL;
-  return file_open(inode);
+  if (inode == NULL || inode_is_removed (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
+  return file_open (inode);
 }
 
 /* Deletes the file named NAME.
@@ -110,13 +168,15 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  int len = strlen(name);
-  char directory[len];
-  char filename[len];
-  parse_path_name(name, directory, filename);
-  struct dir *dir = dir_open_path (directory);
-  bool success = dir != NULL && dir_remove (dir, filename);
+  char filename[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_parent (name, filename);
+  success = dir != NULL && dir_remove (dir, filename);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
@@ -2,19 +2,25 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include "devices/block.h"
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define LFS_SECTOR 2            /* Log-structured write mode state. */
+#define JOURNAL_SECTOR 3        /* First sector of the metadata journal. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
 
-void filesys_init (bool format);
+void filesys_init (bool format, bool log_mode);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
+bool filesys_create_extent (const char *name, off_t size,
+                            block_sector_t *first);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+void filesys_sync (void);
 
 #endif /* filesys/filesys.h */
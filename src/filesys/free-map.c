@@ -4,19 +4,49 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors released since the last journal commit.  The free map
+   on disk already shows them free, but the commit that says so
+   may not have happened yet: until it does, a crash would replay
+   metadata that still points at them, so they must not be handed
+   out and overwritten. */
+static struct bitmap *pending;
+
+/* Sectors from here on are left to the log in log-structured
+   mode: free_map_allocate() only takes them once the sectors
+   below are exhausted. */
+static block_sector_t log_start;
+
+static block_sector_t scan (size_t cnt);
+static block_sector_t scan_below (block_sector_t limit, size_t cnt);
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  pending = bitmap_create (block_size (fs_device));
+  if (free_map == NULL || pending == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, LFS_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SIZE, true);
+  log_start = block_size (fs_device);
+}
+
+/* Leaves the sectors from START on to the log, which claims them
+   with free_map_claim(), by allocating elsewhere while there is
+   room. */
+void
+free_map_reserve_log (block_sector_t start)
+{
+  ASSERT (start <= bitmap_size (free_map));
+  log_start = start;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,7 +57,9 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  block_sector_t sector = scan (cnt);
+  if (sector != BITMAP_ERROR)
+    bitmap_set_multiple (free_map, sector, cnt, true);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
@@ -40,15 +72,95 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates the CNT sectors starting at SECTOR, if they are all
+   free.  Returns true if successful, false otherwise. */
+bool
+free_map_claim (block_sector_t sector, size_t cnt)
+{
+  if (free_map_count_used (sector, cnt) != 0)
+    return false;
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+    {
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      return false;
+    }
+  return true;
+}
+
+/* Finds CNT consecutive free sectors and stores the first into
+   *SECTORP, without allocating them.  Returns true if successful,
+   false if not enough consecutive sectors are free. */
+bool
+free_map_find (size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t sector = scan (cnt);
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Returns the number of the CNT sectors starting at SECTOR that
+   are in use, counting those released but not yet committed. */
+size_t
+free_map_count_used (block_sector_t sector, size_t cnt)
+{
+  return (bitmap_count (free_map, sector, cnt, true)
+          + bitmap_count (pending, sector, cnt, true));
+}
+
+/* Makes CNT sectors starting at SECTOR available for use once the
+   running journal transaction commits. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
+  bitmap_set_multiple (pending, sector, cnt, true);
   bitmap_write (free_map, free_map_file);
 }
 
+/* Makes the sectors released before the journal commit that just
+   completed available for use.  Called by the journal. */
+void
+free_map_commit (void)
+{
+  if (pending != NULL)
+    bitmap_set_all (pending, false);
+}
+
+/* Returns the first of CNT consecutive sectors that are free and
+   not awaiting a commit, preferring those below log_start, or
+   BITMAP_ERROR if there are none. */
+static block_sector_t
+scan (size_t cnt)
+{
+  block_sector_t sector = scan_below (log_start, cnt);
+  if (sector == BITMAP_ERROR && log_start < bitmap_size (free_map))
+    sector = scan_below (bitmap_size (free_map), cnt);
+  return sector;
+}
+
+/* Returns the first of CNT consecutive sectors below LIMIT that
+   are free and not awaiting a commit, or BITMAP_ERROR if there
+   are none. */
+static block_sector_t
+scan_below (block_sector_t limit, size_t cnt)
+{
+  block_sector_t start = 0;
+
+  for (;;)
+    {
+      block_sector_t sector = bitmap_scan (free_map, start, cnt, false);
+      if (sector == BITMAP_ERROR || sector + cnt > limit)
+        return BITMAP_ERROR;
+      if (bitmap_none (pending, sector, cnt))
+        return sector;
+      start = sector + 1;
+    }
+}
+
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void) 
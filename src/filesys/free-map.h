@@ -10,8 +10,13 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_reserve_log (block_sector_t start);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_claim (block_sector_t, size_t);
+bool free_map_find (size_t, block_sector_t *);
+size_t free_map_count_used (block_sector_t, size_t);
+void free_map_commit (void);
 
 #endif /* filesys/free-map.h */
@@ -1,11 +1,19 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <lz.h>
 #include <debug.h>
 #include <round.h>
+#include <stdlib.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/lfs.h"
+#include "filesys/pagecache.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -19,6 +27,7 @@ struct inode_disk
     block_sector_t double_indirect_block;    
 
     bool isdir;           
+    bool compressed;                    /* Compress full clusters? */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
   };
@@ -28,21 +37,48 @@ struct inode_disk
    return a < b ? a : b;
  }
 
- static bool inode_indirect_allocate(block_sector_t* p, size_t num_sectors, int deep)
+ /* Writes a data sector of a new or growing file: through the
+    journal if the file holds metadata (IS_META), as directories
+    and the free map do, or straight to the buffer cache
+    otherwise. */
+ static void write_data(block_sector_t sector, const void *buffer, bool is_meta)
+ {
+   if (is_meta)
+     journal_write(sector, buffer);
+   else
+     buffer_cache_write(sector, buffer);
+ }
+
+ /* Allocates and zeroes a data sector for block IDX of the file
+    whose inode is in INODE_SECTOR, at the log head if the file
+    system is log-structured and the file is not metadata. */
+ static bool allocate_data(block_sector_t *p, block_sector_t inode_sector, size_t idx, bool is_meta)
+ {
+   bool success = !is_meta && lfs_enabled()
+                  ? lfs_allocate(inode_sector, idx, p)
+                  : free_map_allocate(1, p);
+   if (success)
+     write_data(*p, zeros, is_meta);
+   return success;
+ }
+
+ /* Allocates the NUM_SECTORS data sectors starting at block IDX
+    of the file whose inode is in INODE_SECTOR below index block
+    *P at depth DEEP, and any missing index blocks.  Sectors
+    already allocated are kept. */
+ static bool inode_indirect_allocate(block_sector_t* p, size_t num_sectors, int deep, block_sector_t inode_sector, size_t idx, bool is_meta)
  {
    if (deep == 0) {
-     if (*p == 0) {
-        if (!free_map_allocate(1, p))
-          return false;
-     }
-     buffer_cache_write(*p, zeros);
+     if (*p == 0)
+       return allocate_data(p, inode_sector, idx, is_meta);
      return true;
    }
    block_sector_t blocks[128];
    if (*p == 0) 
    {
-      free_map_allocate(1, p);
-      buffer_cache_write(*p, zeros);
+      if (!free_map_allocate(1, p))
+        return false;
+      journal_write(*p, zeros);
    }
    buffer_cache_read(*p, blocks);
 
@@ -53,13 +89,13 @@ struct inode_disk
    for (i = 0; i < l; i++) 
    {
       size_t tmp = min(num_sectors, unit);
-      if (!inode_indirect_allocate(&blocks[i], tmp, deep - 1))
+      if (!inode_indirect_allocate(&blocks[i], tmp, deep - 1, inode_sector, idx + i * unit, is_meta))
         return false;
       num_sectors -= tmp;
    }
 
    ASSERT(num_sectors == 0);
-   buffer_cache_write(*p, blocks);
+   journal_write(*p, blocks);
    return true;   
  }
  
@@ -71,7 +107,7 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
- static bool inode_allocate (struct inode_disk *disk_inode, off_t length) 
+ static bool inode_allocate (struct inode_disk *disk_inode, block_sector_t inode_sector, off_t length, bool is_meta) 
  {
    if (length < 0) return false;
 
@@ -83,9 +119,8 @@ bytes_to_sectors (off_t size)
    {
      if (disk_inode->direct_block[i] == 0) 
      {
-       if (!free_map_allocate(1, &disk_inode -> direct_block[i])) 
+       if (!allocate_data(&disk_inode -> direct_block[i], inode_sector, i, is_meta)) 
           return false;
-       buffer_cache_write(disk_inode->direct_block[i], zeros);
      }
    }
    num_sectors -= l;
@@ -93,14 +128,14 @@ bytes_to_sectors (off_t size)
 
    //second allocate indirect blocks
    l = min(num_sectors, 128);
-   if (!inode_indirect_allocate(&disk_inode->indirect_block, l, 1))
+   if (!inode_indirect_allocate(&disk_inode->indirect_block, l, 1, inode_sector, 123, is_meta))
       return false;
    num_sectors -= l;
    if (num_sectors == 0) return true;
 
    //third allocate double indirect blocks
    l = min(num_sectors, 128 * 128);
-   if (!inode_indirect_allocate(&disk_inode->double_indirect_block, l, 2))
+   if (!inode_indirect_allocate(&disk_inode->double_indirect_block, l, 2, inode_sector, 123 + 128, is_meta))
       return false;
    num_sectors -= l;
    if (num_sectors == 0) return true;
@@ -119,9 +154,47 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    bool thawed;                        /* Raw clusters to compress? */
+    struct lock move_lock;              /* Held while data blocks move. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Keeps INODE's data blocks from being moved while the caller
+   reads or writes them.  Page faults and mmap write-back reach
+   file data outside the serialization that file system calls
+   rely on, so every access takes INODE's move_lock, which
+   inode_defragment() and the cleaner hold while they move blocks.
+   An access may already hold it when copying to a user buffer
+   faults in a page mapped from the same file.  Returns true if
+   the lock was taken, in which case the caller must pass true to
+   unlock_data(). */
+static bool
+lock_data (struct inode *inode)
+{
+  if (lock_held_by_current_thread (&inode->move_lock))
+    return false;
+  lock_acquire (&inode->move_lock);
+  return true;
+}
+
+/* Ends an access started with lock_data(), which returned
+   TAKEN. */
+static void
+unlock_data (struct inode *inode, bool taken)
+{
+  if (taken)
+    lock_release (&inode->move_lock);
+}
+
+
+/* Returns true if the contents of the file whose inode is
+   DISK_INODE, in SECTOR, are themselves file system metadata and
+   so must be journaled. */
+static bool
+is_meta_inode (block_sector_t sector, const struct inode_disk *disk_inode)
+{
+  return disk_inode->isdir || sector == FREE_MAP_SECTOR;
+}
 
 static block_sector_t 
 index_to_sector(const struct inode_disk *ptr, off_t index) 
@@ -175,6 +248,312 @@ byte_to_sector (const struct inode *inode, off_t pos)
     return -1;
 }
 
+/* Most sectors moved by one multi-sector transfer. */
+#define INODE_RUN_MAX 64
+
+/* If a transfer of SIZE bytes at OFFSET within INODE starts on a
+   sector boundary and covers at least one whole sector, returns
+   the number of those sectors, up to INODE_RUN_MAX, that are
+   physically contiguous on disk, and stores the first in *FIRST.
+   Each index block is read only once.  Otherwise returns 0. */
+static size_t
+contiguous_run (const struct inode *inode, off_t offset, off_t size,
+                block_sector_t *first)
+{
+  const struct inode_disk *d = &inode->data;
+  block_sector_t blocks[128];
+  int loaded = -1;      /* Index block in BLOCKS: 0 for the indirect
+                           block, G + 1 for double-indirect group G. */
+  off_t left = inode_length (inode) - offset;
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  size_t cnt, i;
+
+  if (size < left)
+    left = size;
+  if (offset % BLOCK_SECTOR_SIZE != 0 || left < BLOCK_SECTOR_SIZE)
+    return 0;
+
+  cnt = min (left / BLOCK_SECTOR_SIZE, INODE_RUN_MAX);
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = idx + i;
+      block_sector_t sector;
+
+      if (j < 123)
+        sector = d->direct_block[j];
+      else
+        {
+          int group;
+
+          j -= 123;
+          if (j < 128)
+            group = 0;
+          else
+            {
+              j -= 128;
+              group = j / 128 + 1;
+              j %= 128;
+            }
+          if (group != loaded)
+            {
+              if (group == 0)
+                buffer_cache_read (d->indirect_block, blocks);
+              else
+                {
+                  buffer_cache_read (d->double_indirect_block, blocks);
+                  buffer_cache_read (blocks[group - 1], blocks);
+                }
+              loaded = group;
+            }
+          sector = blocks[j];
+        }
+
+      if (i == 0)
+        *first = sector;
+      else if (sector != *first + i)
+        break;
+    }
+  return i;
+}
+
+/* Points block IDX of INODE at SECTOR. */
+static void
+inode_set_block (struct inode *inode, size_t idx, block_sector_t sector)
+{
+  struct inode_disk *d = &inode->data;
+  block_sector_t blocks[128];
+  block_sector_t index_sector;
+
+  if (idx < 123)
+    {
+      d->direct_block[idx] = sector;
+      journal_write (inode->sector, d);
+      return;
+    }
+
+  idx -= 123;
+  if (idx < 128)
+    index_sector = d->indirect_block;
+  else
+    {
+      idx -= 128;
+      buffer_cache_read (d->double_indirect_block, blocks);
+      index_sector = blocks[idx / 128];
+      idx %= 128;
+    }
+  buffer_cache_read (index_sector, blocks);
+  blocks[idx] = sector;
+  journal_write (index_sector, blocks);
+}
+
+/* In log-structured mode, moves block IDX of INODE, now in
+   SECTOR, to the log head unless it is already there: writes
+   DATA, its new contents, through to a sector there, points the
+   block at it, and releases SECTOR.  The data is on disk before
+   the journaled index update can commit, and the free map holds
+   SECTOR back until it does, so a crash never leaves the block
+   pointing at a sector that was not written or was reused.
+   Returns the sector that now holds the block, which is SECTOR if
+   it was not moved, in which case DATA has not been written. */
+static block_sector_t
+inode_relocate_block (struct inode *inode, size_t idx, block_sector_t sector,
+                      const void *data)
+{
+  block_sector_t new_sector;
+
+  if (!lfs_enabled ()
+      || is_meta_inode (inode->sector, &inode->data)
+      || lfs_in_log_head (sector)
+      || !lfs_allocate (inode->sector, idx, &new_sector))
+    return sector;
+
+  buffer_cache_write_multiple (new_sector, 1, data);
+  inode_set_block (inode, idx, new_sector);
+  free_map_release (sector, 1);
+  buffer_cache_discard (sector);
+  return new_sector;
+}
+
+/* Transparent compression.
+
+   A file with the compressed attribute is divided into clusters
+   of CLUSTER_SECTORS blocks.  A full cluster that compresses well
+   keeps its compressed form, preceded by its 2-byte length, in
+   its first blocks, and the index entries of the blocks it saves
+   are COMPRESSED_HOLE, so the cluster map lives in the index
+   blocks themselves: a cluster is compressed exactly when its
+   last entry is a hole.  Writing to a cluster expands it back to
+   raw sectors, and raw clusters are compressed again when the
+   last opener closes the file, so data written once and then
+   mostly read costs fewer sector transfers. */
+
+/* Blocks per compression cluster. */
+#define CLUSTER_SECTORS 8
+#define CLUSTER_SIZE (CLUSTER_SECTORS * BLOCK_SECTOR_SIZE)
+
+/* Index entry of a block saved by compressing its cluster. */
+#define COMPRESSED_HOLE ((block_sector_t) -2)
+
+/* Returns true if CLUSTER of INODE is stored compressed. */
+static bool
+cluster_compressed (const struct inode *inode, size_t cluster)
+{
+  size_t last = cluster * CLUSTER_SECTORS + CLUSTER_SECTORS - 1;
+
+  return (inode->data.compressed
+          && last < bytes_to_sectors (inode->data.length)
+          && index_to_sector (&inode->data, last) == COMPRESSED_HOLE);
+}
+
+/* Reads compressed CLUSTER of INODE and expands it into BUF,
+   which must hold CLUSTER_SIZE bytes.  Returns false if the
+   cluster is corrupt or memory runs out. */
+static bool
+cluster_read (const struct inode *inode, size_t cluster, uint8_t *buf)
+{
+  size_t idx = cluster * CLUSTER_SECTORS;
+  uint8_t *packed = malloc (CLUSTER_SIZE);
+  size_t len, cnt, i;
+  bool success = false;
+
+  if (packed == NULL)
+    return false;
+
+  /* The length in the first sector tells how many follow. */
+  buffer_cache_read (index_to_sector (&inode->data, idx), packed);
+  len = packed[0] | (packed[1] << 8);
+  cnt = DIV_ROUND_UP (2 + len, BLOCK_SECTOR_SIZE);
+  if (cnt < CLUSTER_SECTORS)
+    {
+      for (i = 1; i < cnt; i++)
+        buffer_cache_read (index_to_sector (&inode->data, idx + i),
+                           packed + i * BLOCK_SECTOR_SIZE);
+      success = (lz_decompress (packed + 2, len, buf, CLUSTER_SIZE)
+                 == CLUSTER_SIZE);
+    }
+  free (packed);
+  return success;
+}
+
+/* Compresses raw, full CLUSTER of INODE if that saves at least
+   one sector.  The compressed form goes to new sectors, written
+   through to disk before the index is switched to them, so that
+   after a crash the index points either at the intact raw
+   sectors or at the complete compressed ones.  The raw sectors
+   are not reused before the switch commits, since the free map
+   holds released sectors back until then.  RAW and PACKED are
+   CLUSTER_SIZE-byte buffers and TABLE is scratch space for
+   lz_compress().  Must be called within a journal operation. */
+static void
+cluster_compress (struct inode *inode, size_t cluster, uint8_t *raw,
+                  uint8_t *packed, uint16_t *table)
+{
+  size_t idx = cluster * CLUSTER_SECTORS;
+  block_sector_t sectors[CLUSTER_SECTORS];
+  block_sector_t new_sectors[CLUSTER_SECTORS];
+  size_t len, cnt, i;
+
+  for (i = 0; i < CLUSTER_SECTORS; i++)
+    {
+      sectors[i] = index_to_sector (&inode->data, idx + i);
+      buffer_cache_read (sectors[i], raw + i * BLOCK_SECTOR_SIZE);
+    }
+  len = lz_compress (raw, CLUSTER_SIZE, packed + 2,
+                     CLUSTER_SIZE - BLOCK_SECTOR_SIZE - 2, table);
+  if (len == 0)
+    return;
+
+  packed[0] = len & 0xff;
+  packed[1] = len >> 8;
+  cnt = DIV_ROUND_UP (2 + len, BLOCK_SECTOR_SIZE);
+  memset (packed + 2 + len, 0, cnt * BLOCK_SECTOR_SIZE - 2 - len);
+  for (i = 0; i < cnt; i++)
+    {
+      if (!allocate_data (&new_sectors[i], inode->sector, idx + i, false))
+        {
+          while (i-- > 0)
+            {
+              free_map_release (new_sectors[i], 1);
+              buffer_cache_discard (new_sectors[i]);
+            }
+          return;
+        }
+      buffer_cache_write_multiple (new_sectors[i], 1,
+                                   packed + i * BLOCK_SECTOR_SIZE);
+    }
+
+  for (i = 0; i < CLUSTER_SECTORS; i++)
+    {
+      inode_set_block (inode, idx + i,
+                       i < cnt ? new_sectors[i] : COMPRESSED_HOLE);
+      free_map_release (sectors[i], 1);
+      buffer_cache_discard (sectors[i]);
+    }
+}
+
+/* Expands CLUSTER of INODE back into raw sectors, if it is
+   compressed, so that it can be written in place.  Must be called
+   within a journal operation.  Returns false if memory or disk
+   space runs out. */
+static bool
+cluster_thaw (struct inode *inode, size_t cluster)
+{
+  size_t idx = cluster * CLUSTER_SECTORS;
+  uint8_t *raw;
+  size_t i;
+  bool success = false;
+
+  if (!cluster_compressed (inode, cluster))
+    return true;
+  raw = malloc (CLUSTER_SIZE);
+  if (raw == NULL || !cluster_read (inode, cluster, raw))
+    goto done;
+
+  /* The cluster stays compressed until its last hole is filled. */
+  for (i = 0; i < CLUSTER_SECTORS; i++)
+    if (index_to_sector (&inode->data, idx + i) == COMPRESSED_HOLE)
+      {
+        block_sector_t sector;
+        if (!allocate_data (&sector, inode->sector, idx + i, false))
+          goto done;
+        inode_set_block (inode, idx + i, sector);
+      }
+  for (i = 0; i < CLUSTER_SECTORS; i++)
+    buffer_cache_write (index_to_sector (&inode->data, idx + i),
+                        raw + i * BLOCK_SECTOR_SIZE);
+  success = true;
+
+ done:
+  free (raw);
+  return success;
+}
+
+/* Compresses every full, raw cluster of INODE. */
+static void
+inode_compress (struct inode *inode)
+{
+  size_t cnt = inode->data.length / CLUSTER_SIZE;
+  uint8_t *raw = malloc (CLUSTER_SIZE);
+  uint8_t *packed = malloc (CLUSTER_SIZE);
+  uint16_t *table = malloc (LZ_TABLE_SIZE * sizeof *table);
+  size_t i;
+
+  if (raw != NULL && packed != NULL && table != NULL)
+    {
+      for (i = 0; i < cnt; i++)
+        if (!cluster_compressed (inode, i))
+          {
+            journal_begin ();
+            cluster_compress (inode, i, raw, packed, table);
+            journal_end ();
+          }
+      inode->thawed = false;
+    }
+  free (raw);
+  free (packed);
+  free (table);
+}
+
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
@@ -210,9 +589,10 @@ inode_create (block_sector_t sector, off_t length, bool isdir)
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
       disk_inode->isdir = isdir;
-      if (inode_allocate(disk_inode, disk_inode->length))
+      if (inode_allocate(disk_inode, sector, disk_inode->length,
+                         is_meta_inode (sector, disk_inode)))
         {
-          buffer_cache_write (sector, disk_inode);
+          journal_write (sector, disk_inode);
           success = true; 
         } 
       free (disk_inode);
@@ -220,6 +600,87 @@ inode_create (block_sector_t sector, off_t length, bool isdir)
   return success;
 }
 
+/* Points the NUM_SECTORS data entries below a new index block,
+   stored in *P, at depth DEEP at consecutive sectors starting at
+   *NEXT, which is advanced past them.  Returns false, with no
+   index block left allocated, if the free map runs out. */
+static bool
+inode_indirect_fill (block_sector_t *p, size_t num_sectors, int deep,
+                     block_sector_t *next)
+{
+  block_sector_t blocks[128];
+  size_t unit = deep == 1 ? 1 : 128;
+  size_t i;
+
+  if (!free_map_allocate (1, p))
+    return false;
+  memset (blocks, 0, sizeof blocks);
+  for (i = 0; i < DIV_ROUND_UP (num_sectors, unit); i++)
+    if (deep == 1)
+      blocks[i] = (*next)++;
+    else if (!inode_indirect_fill (&blocks[i],
+                                   min (num_sectors - i * unit, unit),
+                                   deep - 1, next))
+      {
+        /* An inode's index is at most two levels deep, so each
+           filled child points only at data and is one sector. */
+        while (i-- > 0)
+          free_map_release (blocks[i], 1);
+        free_map_release (*p, 1);
+        return false;
+      }
+  journal_write (*p, blocks);
+  return true;
+}
+
+/* Like inode_create(), for a regular file whose LENGTH bytes of
+   data are allocated as one physically contiguous extent in a
+   single free map operation, and stores the extent's first sector
+   in *FIRST.  The data sectors are not zeroed: the caller must
+   write all of them, for example with buffer_cache_write_multiple().
+   Returns false if no free extent is long enough. */
+bool
+inode_create_extent (block_sector_t sector, off_t length,
+                     block_sector_t *first)
+{
+  struct inode_disk *disk_inode;
+  size_t cnt = bytes_to_sectors (length);
+  block_sector_t next;
+  bool success = false;
+
+  ASSERT (length > 0);
+
+  disk_inode = calloc (1, sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+  if (free_map_allocate (cnt, first))
+    {
+      size_t i;
+
+      disk_inode->length = length;
+      disk_inode->magic = INODE_MAGIC;
+      next = *first;
+      for (i = 0; i < min (cnt, 123); i++)
+        disk_inode->direct_block[i] = next++;
+      success = (cnt <= 123
+                 || inode_indirect_fill (&disk_inode->indirect_block,
+                                         min (cnt - 123, 128), 1, &next));
+      if (success && cnt > 123 + 128
+          && !inode_indirect_fill (&disk_inode->double_indirect_block,
+                                   cnt - 123 - 128, 2, &next))
+        {
+          free_map_release (disk_inode->indirect_block, 1);
+          success = false;
+        }
+      if (success)
+        journal_write (sector, disk_inode);
+      else
+        free_map_release (*first, cnt);
+    }
+  free (disk_inode);
+  return success;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
@@ -252,6 +713,8 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  inode->thawed = false;
+  lock_init (&inode->move_lock);
   buffer_cache_read (inode->sector, &inode->data);
   return inode;
 }
@@ -276,7 +739,8 @@ void inode_delete_indirect(block_sector_t ptr, size_t num_sectors, int deep)
 {
   if (deep == 0) 
   {
-    free_map_release(ptr, 1);
+    if (ptr != COMPRESSED_HOLE)
+      free_map_release(ptr, 1);
     return;
   }
 
@@ -308,7 +772,8 @@ void inode_delete(struct inode *inode)
   //free direct block
   l = min(num_sectors, 123);
   for (i = 0; i < l; i++)
-    free_map_release(inode->data.direct_block[i], 1);
+    if (inode->data.direct_block[i] != COMPRESSED_HOLE)
+      free_map_release(inode->data.direct_block[i], 1);
   num_sectors -= l;
   if (num_sectors == 0) return;
 
@@ -324,9 +789,103 @@ void inode_delete(struct inode *inode)
   ASSERT("GG");
 }
 
+/* Releases data sectors FROM through TO - 1 covered by the index
+   block *P at depth DEEP (1 = indirect, 2 = double indirect),
+   where sector numbers are relative to the block's coverage.
+   Sectors at or beyond TO must already be unallocated, so if
+   FROM is 0 the index block itself is released too. */
+static void
+inode_release_indirect (block_sector_t *p, size_t from, size_t to, int deep)
+{
+  block_sector_t blocks[128];
+  size_t unit = deep == 1 ? 1 : 128;
+  size_t i;
+
+  if (*p == 0)
+    return;
+
+  buffer_cache_read (*p, blocks);
+  for (i = from / unit; i < DIV_ROUND_UP (to, unit); i++)
+    {
+      size_t lo = i * unit;
+      if (deep == 1)
+        {
+          if (blocks[i] != 0 && blocks[i] != COMPRESSED_HOLE)
+            free_map_release (blocks[i], 1);
+          blocks[i] = 0;
+        }
+      else
+        inode_release_indirect (&blocks[i], from > lo ? from - lo : 0,
+                                min (to - lo, unit), deep - 1);
+    }
+
+  if (from == 0)
+    {
+      free_map_release (*p, 1);
+      *p = 0;
+    }
+  else
+    journal_write (*p, blocks);
+}
+
+/* Shrinks INODE to LENGTH bytes, releasing every data and index
+   sector no longer needed.  Does nothing if INODE is not longer
+   than LENGTH. */
+void
+inode_truncate (struct inode *inode, off_t length)
+{
+  struct inode_disk *d = &inode->data;
+  size_t from = bytes_to_sectors (length);
+  size_t to = bytes_to_sectors (d->length);
+  size_t i;
+
+  ASSERT (length >= 0);
+  if (length >= d->length)
+    return;
+
+  /* A compressed cluster cut short is no longer full. */
+  if (length % CLUSTER_SIZE != 0
+      && !cluster_thaw (inode, length / CLUSTER_SIZE))
+    return;
+
+  /* Zero the tail of the last kept sector, so that growing the
+     inode again reads back zeros. */
+  if (length % BLOCK_SECTOR_SIZE != 0)
+    {
+      uint8_t buf[BLOCK_SECTOR_SIZE];
+      int ofs = length % BLOCK_SECTOR_SIZE;
+      block_sector_t sector = byte_to_sector (inode, length);
+
+      buffer_cache_read (sector, buf);
+      memset (buf + ofs, 0, BLOCK_SECTOR_SIZE - ofs);
+      write_data (sector, buf, is_meta_inode (inode->sector, d));
+    }
+
+  for (i = from; i < min (to, 123); i++)
+    {
+      if (d->direct_block[i] != COMPRESSED_HOLE)
+        free_map_release (d->direct_block[i], 1);
+      d->direct_block[i] = 0;
+    }
+  if (to > 123)
+    inode_release_indirect (&d->indirect_block,
+                            from > 123 ? from - 123 : 0,
+                            min (to - 123, 128), 1);
+  if (to > 123 + 128)
+    inode_release_indirect (&d->double_indirect_block,
+                            from > 123 + 128 ? from - 123 - 128 : 0,
+                            to - 123 - 128, 2);
+
+  d->length = length;
+  journal_write (inode->sector, d);
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If INODE was also a removed inode, frees its blocks.
+   The last close of a compressed file rewrites its data and
+   index, so like any other file system operation it must be
+   serialized by the caller. */
 void
 inode_close (struct inode *inode) 
 {
@@ -337,14 +896,21 @@ inode_close (struct inode *inode)
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
     {
+      /* Compress the clusters written while it was open. */
+      if (inode->thawed && !inode->removed)
+        inode_compress (inode);
+
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          journal_begin ();
           free_map_release (inode->sector, 1);
           inode_delete(inode);
+          journal_end ();
+          pagecache_purge (inode->sector);
         }
 
       free (inode); 
@@ -360,18 +926,89 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET.
+   If DIRECT is true, whole sectors not in the buffer cache are
+   read straight into BUFFER.  See inode_read_at(). */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+         bool direct)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
+  uint8_t *expanded = NULL;             /* Last compressed cluster read. */
+  size_t expanded_cluster = SIZE_MAX;
+  bool page_cached = pagecache_in_use (inode->sector);
 
   while (size > 0) 
     {
+      /* A page cached for memory mapping holds the latest data,
+         including stores through the mapping, so a run must not
+         reach past the end of the page. */
+      off_t run_size = size;
+      if (page_cached)
+        {
+          off_t inode_left = inode_length (inode) - offset;
+          off_t page_left = PGSIZE - offset % PGSIZE;
+          off_t chunk_size = size < page_left ? size : page_left;
+          if (inode_left < chunk_size)
+            chunk_size = inode_left;
+          if (chunk_size > 0
+              && pagecache_read (inode->sector, offset,
+                                 buffer + bytes_read, chunk_size))
+            {
+              size -= chunk_size;
+              offset += chunk_size;
+              bytes_read += chunk_size;
+              continue;
+            }
+          run_size = chunk_size;
+        }
+
+      /* Expand compressed clusters.  A run must not reach into
+         one, since its sectors do not hold raw data. */
+      if (inode->data.compressed)
+        {
+          size_t cluster = offset / CLUSTER_SIZE;
+          off_t cluster_left = CLUSTER_SIZE - offset % CLUSTER_SIZE;
+          if (cluster_compressed (inode, cluster))
+            {
+              off_t chunk_size = size < cluster_left ? size : cluster_left;
+              if (expanded == NULL)
+                {
+                  expanded = malloc (CLUSTER_SIZE);
+                  if (expanded == NULL)
+                    break;
+                }
+              if (expanded_cluster != cluster)
+                {
+                  if (!cluster_read (inode, cluster, expanded))
+                    break;
+                  expanded_cluster = cluster;
+                }
+              memcpy (buffer + bytes_read,
+                      expanded + offset % CLUSTER_SIZE, chunk_size);
+              size -= chunk_size;
+              offset += chunk_size;
+              bytes_read += chunk_size;
+              continue;
+            }
+          if (run_size > cluster_left)
+            run_size = cluster_left;
+        }
+
+      /* Read physically contiguous whole sectors in one go. */
+      block_sector_t first;
+      size_t run = contiguous_run (inode, offset, run_size, &first);
+      if (run > 1 || (direct && run == 1))
+        {
+          buffer_cache_read_multiple (first, run, buffer + bytes_read);
+          size -= run * BLOCK_SECTOR_SIZE;
+          offset += run * BLOCK_SECTOR_SIZE;
+          bytes_read += run * BLOCK_SECTOR_SIZE;
+          continue;
+        }
+
       /* Disk sector to read, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -411,37 +1048,109 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       bytes_read += chunk_size;
     }
   free (bounce);
+  free (expanded);
 
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  bool taken = lock_data (inode);
+  off_t bytes_read = read_at (inode, buffer, size, offset, false);
+  unlock_data (inode, taken);
+  return bytes_read;
+}
+
+/* As inode_read_at(), but whole sectors that are not in the
+   buffer cache are read straight from disk into BUFFER without
+   being cached, for bulk transfers that would only churn the
+   cache. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
+                   off_t offset)
+{
+  bool taken = lock_data (inode);
+  off_t bytes_read = read_at (inode, buffer, size, offset, true);
+  unlock_data (inode, taken);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   If DIRECT is true, whole sectors of file data are written
+   straight to disk.  See inode_write_at(). */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
+          off_t offset, bool direct)
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
+  bool is_meta = is_meta_inode (inode->sector, &inode->data);
+  bool extend, logged;
 
   if (inode->deny_write_cnt)
     return 0;
 
-  if (byte_to_sector(inode, offset + size - 1) == -1u) 
+  /* Growing a file, writing to a directory or the free map,
+     moving rewritten blocks to the log head, or expanding
+     compressed clusters changes metadata, which is committed as
+     one operation. */
+  extend = byte_to_sector(inode, offset + size - 1) == -1u;
+  logged = is_meta || extend || lfs_enabled () || inode->data.compressed;
+  if (logged)
+    journal_begin ();
+
+  if (extend) 
   {
-    if (!inode_allocate(&inode -> data, offset + size)) 
+    if (!inode_allocate(&inode -> data, inode->sector, offset + size, is_meta)) 
+    {
+      journal_end ();
       return 0; //fail to extend
+    }
     inode->data.length = offset + size;
-    buffer_cache_write(inode->sector, &inode->data);
+    journal_write(inode->sector, &inode->data);
 
   }
 
+  /* Clusters of a compressed file are written raw, and compressed
+     again when the file is closed. */
+  if (inode->data.compressed && size > 0)
+    {
+      size_t cluster;
+      for (cluster = offset / CLUSTER_SIZE;
+           cluster <= (size_t) (offset + size - 1) / CLUSTER_SIZE; cluster++)
+        if (!cluster_thaw (inode, cluster))
+          {
+            journal_end ();
+            return 0;
+          }
+      inode->thawed = true;
+    }
+
   while (size > 0) 
     {
+      /* For direct I/O, write physically contiguous whole sectors
+         of file data straight to disk in one go.  Other writes stay
+         in the buffer cache, whose sorted write-back and write
+         combining turn adjacent dirty sectors into large transfers
+         later.  Metadata is journaled and rewritten blocks are
+         moved in log-structured mode, both sector by sector. */
+      block_sector_t first;
+      size_t run = (!direct || is_meta || lfs_enabled () ? 0
+                    : contiguous_run (inode, offset, size, &first));
+      if (run > 0)
+        {
+          buffer_cache_write_multiple (first, run, buffer + bytes_written);
+          size -= run * BLOCK_SECTOR_SIZE;
+          offset += run * BLOCK_SECTOR_SIZE;
+          bytes_written += run * BLOCK_SECTOR_SIZE;
+          continue;
+        }
+
       /* Sector to write, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -459,7 +1168,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
           /* Write full sector directly to disk. */
-          buffer_cache_write (sector_idx, buffer + bytes_written);
+          if (inode_relocate_block (inode, offset / BLOCK_SECTOR_SIZE,
+                                    sector_idx, buffer + bytes_written)
+              == sector_idx)
+            write_data (sector_idx, buffer + bytes_written, is_meta);
         }
       else 
         {
@@ -479,7 +1191,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
           memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          buffer_cache_write (sector_idx, bounce);
+          if (inode_relocate_block (inode, offset / BLOCK_SECTOR_SIZE,
+                                    sector_idx, bounce)
+              == sector_idx)
+            write_data (sector_idx, bounce, is_meta);
         }
 
       /* Advance. */
@@ -488,10 +1203,120 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
   free (bounce);
+  if (logged)
+    journal_end ();
+
+  /* Keep pages cached for memory mapping up to date. */
+  if (!is_meta)
+    pagecache_write (inode->sector, offset - bytes_written, buffer,
+                     bytes_written);
+
+  return bytes_written;
+}
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if an error occurs.  Writing past the end of
+   INODE extends it. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  bool taken = lock_data (inode);
+  off_t bytes_written = write_at (inode, buffer, size, offset, false);
+  unlock_data (inode, taken);
   return bytes_written;
 }
 
+/* As inode_write_at(), but whole sectors of file data are written
+   straight from BUFFER to disk, updating any cached copies
+   without caching the others. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+                    off_t offset)
+{
+  bool taken = lock_data (inode);
+  off_t bytes_written = write_at (inode, buffer, size, offset, true);
+  unlock_data (inode, taken);
+  return bytes_written;
+}
+
+/* Dirty cache sectors, sorted, and which of them hold data of
+   the inode being flushed.  See inode_flush(). */
+struct flush_set
+  {
+    block_sector_t sectors[BUFFER_CACHE_SIZE];
+    size_t cnt;
+    bool data[BUFFER_CACHE_SIZE];       /* File data to write. */
+  };
+
+static int
+compare_sector (const void *a_, const void *b_)
+{
+  block_sector_t a = *(const block_sector_t *) a_;
+  block_sector_t b = *(const block_sector_t *) b_;
+  return a < b ? -1 : a > b;
+}
+
+/* Marks data SECTOR in SET, if it is dirty. */
+static void
+flush_set_mark (struct flush_set *set, block_sector_t sector)
+{
+  block_sector_t *p = bsearch (&sector, set->sectors, set->cnt,
+                               sizeof *set->sectors, compare_sector);
+  if (p != NULL)
+    set->data[p - set->sectors] = true;
+}
+
+/* Marks the first CNT data sectors reachable from index block
+   SECTOR at depth DEEP. */
+static void
+flush_set_mark_indirect (struct flush_set *set, block_sector_t sector,
+                         size_t cnt, int deep)
+{
+  block_sector_t blocks[128];
+  size_t unit = deep == 1 ? 1 : 128;
+  size_t i;
+
+  buffer_cache_read (sector, blocks);
+  for (i = 0; i < DIV_ROUND_UP (cnt, unit); i++)
+    if (deep == 1)
+      flush_set_mark (set, blocks[i]);
+    else
+      flush_set_mark_indirect (set, blocks[i], min (cnt - i * unit, unit),
+                               deep - 1);
+}
+
+/* Writes INODE's dirty data sectors from the buffer cache back
+   to disk in ascending sector order, to keep the disk head moving
+   one way, then commits the journal so that its index blocks and
+   inode follow.  Other files' dirty data is left in the cache. */
+void
+inode_flush (struct inode *inode)
+{
+  struct flush_set set;
+  size_t n = bytes_to_sectors (inode->data.length);
+  size_t i;
+
+  set.cnt = buffer_cache_dirty_sectors (set.sectors);
+  memset (set.data, 0, sizeof set.data);
+
+  for (i = 0; i < min (n, 123); i++)
+    flush_set_mark (&set, inode->data.direct_block[i]);
+  if (n > 123)
+    flush_set_mark_indirect (&set, inode->data.indirect_block,
+                             min (n - 123, 128), 1);
+  if (n > 123 + 128)
+    flush_set_mark_indirect (&set, inode->data.double_indirect_block,
+                             n - 123 - 128, 2);
+
+  for (i = 0; i < set.cnt; i++)
+    if (set.data[i])
+      buffer_cache_flush_sector (set.sectors[i]);
+  block_flush (fs_device);
+  journal_commit ();
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -519,6 +1344,25 @@ inode_length (const struct inode *inode)
   return inode->data.length;
 }
 
+/* Gives INODE the compressed attribute, which is kept on disk.
+   Its data is compressed when the last opener closes it.  Returns
+   false if INODE does not hold a regular file. */
+bool
+inode_set_compressed (struct inode *inode)
+{
+  if (is_meta_inode (inode->sector, &inode->data))
+    return false;
+  if (!inode->data.compressed)
+    {
+      journal_begin ();
+      inode->data.compressed = true;
+      journal_write (inode->sector, &inode->data);
+      journal_end ();
+      inode->thawed = true;
+    }
+  return true;
+}
+
 bool
 inode_dir(const struct inode *inode) 
 {
@@ -531,8 +1375,133 @@ inode_num(const struct inode *inode)
   return (int)inode->sector;
 }
 
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (const struct inode *inode)
+{
+  return inode->open_cnt;
+}
+
 bool 
 inode_is_removed(const struct inode *inode) 
 {
   return inode->removed;
 }
+
+/* Returns the sector holding block IDX of the regular file whose
+   inode is in INODE_SECTOR, or -1 if that sector does not hold
+   the inode of a regular file with such a block. */
+block_sector_t
+inode_block_lookup (block_sector_t inode_sector, size_t idx)
+{
+  struct inode *inode = inode_open (inode_sector);
+  block_sector_t sector = -1;
+
+  if (inode != NULL
+      && inode->data.magic == INODE_MAGIC
+      && !is_meta_inode (inode_sector, &inode->data)
+      && idx < bytes_to_sectors (inode->data.length))
+    sector = index_to_sector (&inode->data, idx);
+  inode_close (inode);
+  return sector;
+}
+
+/* Moves block IDX of the regular file whose inode is in
+   INODE_SECTOR to the log head, for the log-structured cleaner. */
+void
+inode_move_block (block_sector_t inode_sector, size_t idx)
+{
+  uint8_t buf[BLOCK_SECTOR_SIZE];
+  block_sector_t sector = inode_block_lookup (inode_sector, idx);
+  struct inode *inode;
+
+  if (sector == (block_sector_t) -1 || sector == COMPRESSED_HOLE)
+    return;
+  inode = inode_open (inode_sector);
+  if (inode == NULL)
+    return;
+  lock_acquire (&inode->move_lock);
+  sector = inode_block_lookup (inode_sector, idx);
+  if (sector != (block_sector_t) -1 && sector != COMPRESSED_HOLE)
+    {
+      buffer_cache_read (sector, buf);
+      inode_relocate_block (inode, idx, sector, buf);
+    }
+  lock_release (&inode->move_lock);
+  inode_close (inode);
+}
+
+/* Moves the data of regular file INODE into one physically
+   contiguous extent and rewrites its index blocks to match, so
+   that sequential reads become sequential transfers.  Data is
+   copied INODE_RUN_MAX sectors at a time.  Each batch claims its
+   part of the extent, points the index at it, and releases the
+   old sectors in one journaled operation, after its data is on
+   disk.  The free map does not hand out released sectors until
+   the release commits, so a crash leaves every block intact in
+   either its old place or its new one, and leaks nothing.  Every
+   opener of the file shares INODE, so all of them see the new
+   locations; INODE's move_lock keeps out page faults and mmap
+   write-back, and the caller must serialize this with other file
+   system operations.  Returns true
+   if the file's data is now contiguous, false if it is not a
+   regular file, is compressed, or no free extent is long enough,
+   or if the extent was taken before the move finished. */
+bool
+inode_defragment (struct inode *inode)
+{
+  size_t cnt = bytes_to_sectors (inode->data.length);
+  block_sector_t first;
+  uint8_t *buf;
+  size_t idx;
+  bool success;
+
+  if (is_meta_inode (inode->sector, &inode->data) || inode->data.compressed)
+    return false;
+
+  /* Nothing to do if the data is already contiguous. */
+  if (cnt == 0)
+    return true;
+  first = index_to_sector (&inode->data, 0);
+  for (idx = 1; idx < cnt; idx++)
+    if (index_to_sector (&inode->data, idx) != first + idx)
+      break;
+  if (idx == cnt)
+    return true;
+
+  buf = malloc (INODE_RUN_MAX * BLOCK_SECTOR_SIZE);
+  if (buf == NULL)
+    return false;
+  lock_acquire (&inode->move_lock);
+  success = free_map_find (cnt, &first);
+
+  for (idx = 0; success && idx < cnt; idx += INODE_RUN_MAX)
+    {
+      size_t n = min (cnt - idx, INODE_RUN_MAX);
+      size_t i;
+
+      journal_begin ();
+      if (!free_map_claim (first + idx, n))
+        {
+          journal_end ();
+          success = false;
+          break;
+        }
+      for (i = 0; i < n; i++)
+        buffer_cache_read (index_to_sector (&inode->data, idx + i),
+                           buf + i * BLOCK_SECTOR_SIZE);
+      buffer_cache_write_multiple (first + idx, n, buf);
+
+      for (i = 0; i < n; i++)
+        {
+          block_sector_t old = index_to_sector (&inode->data, idx + i);
+          inode_set_block (inode, idx + i, first + idx + i);
+          free_map_release (old, 1);
+          buffer_cache_discard (old);
+        }
+      journal_end ();
+    }
+  lock_release (&inode->move_lock);
+  free (buf);
+  return success;
+}
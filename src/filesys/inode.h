@@ -9,6 +9,7 @@ struct bitmap;
 
 void inode_init (void);
 bool inode_create (block_sector_t , off_t , bool);
+bool inode_create_extent (block_sector_t, off_t, block_sector_t *first);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
@@ -16,10 +17,21 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+                          off_t offset);
+void inode_truncate (struct inode *, off_t length);
+void inode_flush (struct inode *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_is_directory (const struct inode *);
+bool inode_dir (const struct inode *);
+bool inode_set_compressed (struct inode *);
 bool inode_is_removed (const struct inode *);
+int inode_open_cnt (const struct inode *);
+block_sector_t inode_block_lookup (block_sector_t, size_t idx);
+void inode_move_block (block_sector_t, size_t idx);
+bool inode_defragment (struct inode *);
 
 #endif /* filesys/inode.h */
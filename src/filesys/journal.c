@@ -0,0 +1,340 @@
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A write-ahead redo journal for file system metadata: inodes,
+   index blocks, directory contents, and the free map.
+
+   Metadata writes go to the buffer cache as usual, but are also
+   copied into the running transaction, and the cache never writes
+   them home on its own.  Transactions are committed in groups:
+   once no operation is in progress and enough sectors have been
+   logged (or on sync), all the logged images are written to the
+   journal area in one sequential pass, then the header that makes
+   them valid, then each image is written home in ascending sector
+   order, and finally the header is cleared.  After a crash,
+   journal_init() replays a valid transaction, so metadata is
+   always either entirely before or entirely after each group of
+   operations.  File data is not journaled.
+
+   On-disk layout, starting at JOURNAL_SECTOR:
+     1 header sector,
+     JOURNAL_MAP_SECTORS sectors holding the home sector of each
+     image,
+     JOURNAL_MAX image sectors. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Sectors holding the map of home sectors. */
+#define JOURNAL_MAP_SECTORS (JOURNAL_MAX * sizeof (block_sector_t) \
+                             / BLOCK_SECTOR_SIZE)
+
+/* Commit once no operation is running and this many sectors are
+   logged. */
+#define JOURNAL_COMMIT_THRESHOLD 64
+
+/* Most sectors a single operation can log, apart from the free
+   map: the inode, every index block of a maximum-size file, and
+   the directories being changed. */
+#define JOURNAL_OP_FIXED 140
+
+/* Journal header.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Images logged, 0 if empty. */
+    unsigned checksum;                  /* Over the map and images. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16];
+  };
+
+/* The running transaction. */
+static block_sector_t map[JOURNAL_MAX];         /* Home of each image. */
+static uint8_t (*images)[BLOCK_SECTOR_SIZE];    /* Logged images. */
+static size_t cnt;                              /* Number of images. */
+static struct bitmap *logged;   /* Sectors with an image, for fast tests. */
+static uint32_t seq;            /* Sequence number of next commit. */
+
+/* Operations in progress. */
+static int active;
+
+/* Most sectors a single operation can log: JOURNAL_OP_FIXED plus
+   the whole free map, which is rewritten on every allocation. */
+static size_t op_max;
+
+/* Serializes beginning, ending, and committing transactions.
+   As with the rest of the file system, operations themselves are
+   serialized by their callers. */
+static struct lock journal_lock;
+
+static void commit (void);
+static void recover (void);
+static void write_header (uint32_t cnt, unsigned checksum);
+static unsigned checksum (size_t cnt);
+
+/* Initializes the journal.  If FORMAT is true, starts with an
+   empty journal; otherwise replays any transaction committed but
+   not fully written home before the last shutdown. */
+void
+journal_init (bool format)
+{
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof map == JOURNAL_MAP_SECTORS * BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  images = palloc_get_multiple (PAL_ASSERT,
+                                JOURNAL_MAX * BLOCK_SECTOR_SIZE / PGSIZE);
+  logged = bitmap_create (block_size (fs_device));
+  if (logged == NULL)
+    PANIC ("journal bitmap creation failed");
+  cnt = 0;
+  active = 0;
+  seq = 1;
+
+  /* Every operation must fit in a transaction along with a group
+     that has not yet reached the commit threshold. */
+  op_max = JOURNAL_OP_FIXED
+           + DIV_ROUND_UP (DIV_ROUND_UP (block_size (fs_device), 8),
+                           BLOCK_SECTOR_SIZE);
+  if (op_max + JOURNAL_COMMIT_THRESHOLD > JOURNAL_MAX)
+    PANIC ("file system device too large for a %d-sector journal",
+           JOURNAL_MAX);
+
+  if (format)
+    write_header (0, 0);
+  else
+    recover ();
+}
+
+/* Starts a file system operation.  Its metadata updates are
+   committed together, possibly along with other operations. */
+void
+journal_begin (void)
+{
+  lock_acquire (&journal_lock);
+  if (active == 0 && cnt + op_max > JOURNAL_MAX)
+    commit ();
+  active++;
+  lock_release (&journal_lock);
+}
+
+/* Ends a file system operation started with journal_begin(),
+   committing the group if it has grown large enough. */
+void
+journal_end (void)
+{
+  lock_acquire (&journal_lock);
+  ASSERT (active > 0);
+  if (--active == 0 && cnt >= JOURNAL_COMMIT_THRESHOLD)
+    commit ();
+  lock_release (&journal_lock);
+}
+
+/* Commits everything logged so far and writes it home. */
+void
+journal_commit (void)
+{
+  lock_acquire (&journal_lock);
+  commit ();
+  lock_release (&journal_lock);
+}
+
+/* Writes metadata SECTOR from BUFFER through the buffer cache,
+   logging it in the running transaction. */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  size_t i;
+
+  if (bitmap_test (logged, sector))
+    {
+      for (i = 0; map[i] != sector; i++)
+        ASSERT (i < cnt);
+    }
+  else
+    {
+      /* journal_begin() left room for the whole operation, so
+         running out means an operation logged more than op_max
+         sectors.  Committing here would break its atomicity. */
+      ASSERT (cnt < JOURNAL_MAX);
+      i = cnt++;
+      map[i] = sector;
+      bitmap_mark (logged, sector);
+    }
+  memcpy (images[i], buffer, BLOCK_SECTOR_SIZE);
+  buffer_cache_write_journaled (sector, buffer);
+}
+
+/* If SECTOR has an image in the running transaction, copies it
+   into BUFFER and returns true.  Otherwise returns false. */
+bool
+journal_read (block_sector_t sector, void *buffer)
+{
+  size_t i;
+
+  if (logged == NULL || !bitmap_test (logged, sector))
+    return false;
+  for (i = 0; map[i] != sector; i++)
+    ASSERT (i < cnt);
+  memcpy (buffer, images[i], BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Drops any image of SECTOR from the running transaction, because
+   the sector has been freed and reused for file data, which must
+   not be overwritten by a replay or checkpoint. */
+void
+journal_revoke (block_sector_t sector)
+{
+  size_t i;
+
+  if (logged == NULL || !bitmap_test (logged, sector))
+    return;
+  for (i = 0; map[i] != sector; i++)
+    ASSERT (i < cnt);
+  cnt--;
+  if (i != cnt)
+    {
+      map[i] = map[cnt];
+      memcpy (images[i], images[cnt], BLOCK_SECTOR_SIZE);
+    }
+  bitmap_reset (logged, sector);
+}
+
+/* Orders image slots by home sector. */
+static int
+compare_slots (const void *a_, const void *b_, void *aux UNUSED)
+{
+  block_sector_t a = map[*(const uint16_t *) a_];
+  block_sector_t b = map[*(const uint16_t *) b_];
+  return a < b ? -1 : a > b;
+}
+
+/* Commits the running transaction: logs it, writes it home, and
+   empties the journal.  The journal lock must be held. */
+static void
+commit (void)
+{
+  uint16_t order[JOURNAL_MAX];
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  if (cnt == 0)
+    {
+      free_map_commit ();
+      return;
+    }
+
+  /* Log the map and images in one sequential run, then make the
+     transaction valid by writing its header. */
+  for (i = 0; i < DIV_ROUND_UP (cnt * sizeof *map, BLOCK_SECTOR_SIZE); i++)
+    block_write (fs_device, JOURNAL_SECTOR + 1 + i,
+                 (uint8_t *) map + i * BLOCK_SECTOR_SIZE);
+  for (i = 0; i < cnt; i++)
+    block_write (fs_device, JOURNAL_SECTOR + 1 + JOURNAL_MAP_SECTORS + i,
+                 images[i]);
+  write_header (cnt, checksum (cnt));
+
+  /* Checkpoint in ascending sector order. */
+  for (i = 0; i < cnt; i++)
+    order[i] = i;
+  sort (order, cnt, sizeof *order, compare_slots, NULL);
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t sector = map[order[i]];
+      block_write (fs_device, sector, images[order[i]]);
+      buffer_cache_journal_done (sector);
+      bitmap_reset (logged, sector);
+    }
+
+  write_header (0, 0);
+  cnt = 0;
+  seq++;
+
+  /* Sectors released by the committed operations are now free on
+     disk and no replay or checkpoint will write their old images,
+     so they may be reused. */
+  free_map_commit ();
+}
+
+/* Replays a committed transaction left in the journal, if any. */
+static void
+recover (void)
+{
+  struct journal_header *h = (struct journal_header *) images[0];
+  size_t i, n;
+
+  block_read (fs_device, JOURNAL_SECTOR, h);
+  if (h->magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal; reformat it with -f");
+  seq = h->seq + 1;
+  n = h->cnt;
+  if (n == 0)
+    return;
+  if (n > JOURNAL_MAX)
+    PANIC ("corrupt journal header (%zu images)", n);
+
+  /* A header whose checksum does not match was torn or belongs to
+     stale images, so the transaction never committed. */
+  {
+    unsigned expected = h->checksum;
+
+    for (i = 0; i < JOURNAL_MAP_SECTORS; i++)
+      block_read (fs_device, JOURNAL_SECTOR + 1 + i,
+                  (uint8_t *) map + i * BLOCK_SECTOR_SIZE);
+    for (i = 0; i < n; i++)
+      block_read (fs_device, JOURNAL_SECTOR + 1 + JOURNAL_MAP_SECTORS + i,
+                  images[i]);
+    if (checksum (n) != expected)
+      {
+        write_header (0, 0);
+        return;
+      }
+  }
+
+  printf ("journal: replaying %zu metadata sectors...", n);
+  for (i = 0; i < n; i++)
+    block_write (fs_device, map[i], images[i]);
+  write_header (0, 0);
+  printf ("done.\n");
+}
+
+/* Writes a journal header for a transaction of CNT images with
+   the given CHECKSUM, or an empty one if CNT is 0. */
+static void
+write_header (uint32_t cnt, unsigned checksum)
+{
+  static struct journal_header h;
+
+  memset (&h, 0, sizeof h);
+  h.magic = JOURNAL_MAGIC;
+  h.seq = seq;
+  h.cnt = cnt;
+  h.checksum = checksum;
+  block_write (fs_device, JOURNAL_SECTOR, &h);
+}
+
+/* Returns a checksum of the first CNT map entries and images. */
+static unsigned
+checksum (size_t cnt)
+{
+  unsigned sum = hash_bytes (map, cnt * sizeof *map);
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    sum = sum * 31 + hash_bytes (images[i], BLOCK_SECTOR_SIZE);
+  return sum;
+}
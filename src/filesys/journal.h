@@ -0,0 +1,27 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Most sector images one transaction can hold. */
+#define JOURNAL_MAX 256
+
+/* Sectors the journal occupies on the file system device:
+   a header, the sector map, and the images. */
+#define JOURNAL_SIZE (1 + JOURNAL_MAX * sizeof (block_sector_t) \
+                          / BLOCK_SECTOR_SIZE + JOURNAL_MAX)
+
+void journal_init (bool format);
+
+/* Bracketing file system operations. */
+void journal_begin (void);
+void journal_end (void);
+void journal_commit (void);
+
+/* Metadata updates. */
+void journal_write (block_sector_t, const void *);
+bool journal_read (block_sector_t, void *);
+void journal_revoke (block_sector_t);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,364 @@
+#include "filesys/lfs.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/syscall.h"
+#endif
+
+/* Log-structured write mode, chosen when the file system is
+   formatted.
+
+   The disk is divided into segments of LFS_SEGMENT_SECTORS
+   sectors.  Data sectors of regular files are allocated in order
+   from the current segment, the log head, and a data sector
+   outside the log head is moved to it whenever it is rewritten.
+   The buffer cache's sorted write-back then turns small random
+   writes into sequential runs.  Inodes stay where they are, so
+   unlike a classic LFS no inode map is needed: their updates, and
+   those of the index blocks, are absorbed by the metadata
+   journal, which is itself a sequential log.
+
+   Inodes, index blocks, directory data, and anything else not
+   allocated at the log head come from a metadata area made of the
+   first segments of the disk, so that log segments hold only
+   file blocks recorded in their summaries and can always be
+   cleaned.  Only once the metadata area is full do such
+   allocations spill into the log area.
+
+   The first sector of each segment is a summary recording which
+   file block each sector was allocated for.  A block is still
+   live if its file still points to that sector.  When few free
+   segments remain, a cleaner thread moves the live blocks of
+   nearly empty segments to the log head, freeing whole segments
+   for the log. */
+
+/* Identifies the mode sector and segment summaries. */
+#define LFS_MAGIC 0x4c465331
+
+/* Wake the cleaner when fewer segments than this are free. */
+#define LFS_CLEAN_MIN 4
+
+/* Only clean segments with at most this many live blocks. */
+#define LFS_CLEAN_MAX_LIVE (LFS_SEGMENT_SECTORS / 2)
+
+/* One segment in this many, at least enough to cover the
+   journal, makes up the metadata area. */
+#define LFS_META_SHARE 4
+
+/* Mode sector, at LFS_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct lfs_info
+  {
+    unsigned magic;                     /* LFS_MAGIC. */
+    uint32_t enabled;                   /* Nonzero if log-structured. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8];
+  };
+
+/* Segment summary, in the first sector of each segment.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct lfs_summary
+  {
+    unsigned magic;                     /* LFS_MAGIC. */
+    uint32_t unused;
+    struct
+      {
+        block_sector_t inode;           /* Owning inode, 0 if none. */
+        uint32_t idx;                   /* File block number. */
+      }
+    blocks[LFS_SEGMENT_SECTORS - 1];    /* One per following sector. */
+  };
+
+static bool enabled;                    /* Log-structured mode? */
+static size_t segment_cnt;              /* Segments on the device. */
+static size_t first_segment;            /* First segment of the log. */
+
+/* The log head. */
+static bool head_open;                  /* False if no free segment. */
+static block_sector_t head_start;       /* First sector of segment. */
+static size_t head_ofs;                 /* Next sector to try. */
+static struct lfs_summary head_summary;
+
+/* Cleaner. */
+static struct semaphore clean_sema;     /* Upped to request cleaning. */
+static bool clean_requested;
+
+static void cleaner (void *aux);
+static bool open_head (void);
+static void close_head (void);
+
+/* Initializes log-structured mode.  If FORMAT is true, records
+   whether the new file system is log-structured according to
+   ENABLE; otherwise reads the mode chosen when it was formatted. */
+void
+lfs_init (bool format, bool enable)
+{
+  struct lfs_info info;
+
+  ASSERT (sizeof info == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof head_summary == BLOCK_SECTOR_SIZE);
+
+  if (format)
+    {
+      memset (&info, 0, sizeof info);
+      info.magic = LFS_MAGIC;
+      info.enabled = enable;
+      buffer_cache_write (LFS_SECTOR, &info);
+    }
+  else
+    {
+      buffer_cache_read (LFS_SECTOR, &info);
+      if (info.magic != LFS_MAGIC)
+        PANIC ("file system has no mode sector; reformat it with -f");
+      if (enable && !info.enabled)
+        printf ("filesys: log-structured mode is chosen at format time, "
+                "ignoring -lfs\n");
+    }
+
+  enabled = info.enabled;
+  if (!enabled)
+    return;
+
+  segment_cnt = block_size (fs_device) / LFS_SEGMENT_SECTORS;
+  first_segment = DIV_ROUND_UP (segment_cnt, LFS_META_SHARE);
+  if (first_segment * LFS_SEGMENT_SECTORS < JOURNAL_SECTOR + JOURNAL_SIZE)
+    first_segment = DIV_ROUND_UP (JOURNAL_SECTOR + JOURNAL_SIZE,
+                                  LFS_SEGMENT_SECTORS);
+  if (first_segment > segment_cnt)
+    first_segment = segment_cnt;
+  free_map_reserve_log (first_segment * LFS_SEGMENT_SECTORS);
+  head_open = false;
+  head_start = first_segment * LFS_SEGMENT_SECTORS;
+  sema_init (&clean_sema, 0);
+  clean_requested = false;
+  thread_create ("lfs-cleaner", PRI_DEFAULT, cleaner, NULL);
+}
+
+/* Writes the summary of the log head to the buffer cache. */
+void
+lfs_flush (void)
+{
+  if (enabled && head_open)
+    buffer_cache_write (head_start, &head_summary);
+}
+
+/* Returns true if the file system is log-structured. */
+bool
+lfs_enabled (void)
+{
+  return enabled;
+}
+
+/* Allocates a sector at the log head for block IDX of the file
+   whose inode is in INODE_SECTOR, and stores it in *SECTORP.
+   If no free segment is left, falls back to the first free sector
+   in the metadata area, or anywhere.  Returns true if successful, false if the disk is
+   full. */
+bool
+lfs_allocate (block_sector_t inode_sector, size_t idx,
+              block_sector_t *sectorp)
+{
+  ASSERT (enabled);
+
+  do
+    {
+      /* Sectors of the head taken by other allocations since it
+         was opened are skipped. */
+      while (head_open && head_ofs < LFS_SEGMENT_SECTORS)
+        {
+          block_sector_t sector = head_start + head_ofs++;
+          if (free_map_claim (sector, 1))
+            {
+              head_summary.blocks[sector - head_start - 1].inode
+                = inode_sector;
+              head_summary.blocks[sector - head_start - 1].idx = idx;
+              *sectorp = sector;
+              return true;
+            }
+        }
+      close_head ();
+    }
+  while (open_head ());
+
+  return free_map_allocate (1, sectorp);
+}
+
+/* Returns true if SECTOR is in the log head, where rewriting it
+   in place is already sequential. */
+bool
+lfs_in_log_head (block_sector_t sector)
+{
+  return (head_open
+          && sector >= head_start
+          && sector < head_start + LFS_SEGMENT_SECTORS);
+}
+
+/* Asks the cleaner to free some segments. */
+static void
+request_clean (void)
+{
+  if (!clean_requested)
+    {
+      clean_requested = true;
+      sema_up (&clean_sema);
+    }
+}
+
+/* Returns the number of entirely free segments. */
+static size_t
+count_free_segments (void)
+{
+  size_t i, cnt = 0;
+
+  for (i = first_segment; i < segment_cnt; i++)
+    if (free_map_count_used (i * LFS_SEGMENT_SECTORS,
+                             LFS_SEGMENT_SECTORS) == 0)
+      cnt++;
+  return cnt;
+}
+
+/* Makes the next entirely free log segment after the current one
+   the log head.  Returns false if there is none. */
+static bool
+open_head (void)
+{
+  size_t log_cnt = segment_cnt - first_segment;
+  size_t cur = head_start / LFS_SEGMENT_SECTORS - first_segment;
+  size_t i;
+
+  for (i = 1; i <= log_cnt; i++)
+    {
+      block_sector_t start = ((first_segment + (cur + i) % log_cnt)
+                              * LFS_SEGMENT_SECTORS);
+      if (free_map_count_used (start, LFS_SEGMENT_SECTORS) == 0
+          && free_map_claim (start, 1))
+        {
+          head_open = true;
+          head_start = start;
+          head_ofs = 1;
+          memset (&head_summary, 0, sizeof head_summary);
+          head_summary.magic = LFS_MAGIC;
+          if (count_free_segments () < LFS_CLEAN_MIN)
+            request_clean ();
+          return true;
+        }
+    }
+  request_clean ();
+  return false;
+}
+
+/* Retires the log head, writing out its summary. */
+static void
+close_head (void)
+{
+  if (head_open)
+    {
+      buffer_cache_write (head_start, &head_summary);
+      head_open = false;
+    }
+}
+
+/* Reads the summary of the segment starting at START into *S and
+   returns the number of live blocks in it, or -1 if the segment
+   cannot be cleaned: it is not a log segment, or some sector in
+   it is in use but not as a live file block, such as an index
+   block that spilled out of a full metadata area. */
+static int
+segment_live (block_sector_t start, struct lfs_summary *s)
+{
+  size_t ofs;
+  int live = 0;
+
+  if (free_map_count_used (start, 1) == 0)
+    return -1;
+  buffer_cache_read (start, s);
+  if (s->magic != LFS_MAGIC)
+    return -1;
+
+  for (ofs = 1; ofs < LFS_SEGMENT_SECTORS; ofs++)
+    {
+      block_sector_t sector = start + ofs;
+      block_sector_t inode = s->blocks[ofs - 1].inode;
+
+      if (free_map_count_used (sector, 1) == 0)
+        continue;
+      if (inode == 0
+          || inode >= block_size (fs_device)
+          || free_map_count_used (inode, 1) == 0
+          || inode_block_lookup (inode, s->blocks[ofs - 1].idx) != sector)
+        return -1;
+      live++;
+    }
+  return live;
+}
+
+/* Cleans the log segment with the fewest live blocks, moving them
+   to the log head.  Returns false if no segment is worth
+   cleaning. */
+static bool
+clean_segment (void)
+{
+  struct lfs_summary s;
+  block_sector_t victim = 0;
+  int victim_live = LFS_CLEAN_MAX_LIVE + 1;
+  size_t i, ofs;
+
+  for (i = first_segment; i < segment_cnt; i++)
+    {
+      block_sector_t start = i * LFS_SEGMENT_SECTORS;
+      int live;
+
+      if (lfs_in_log_head (start))
+        continue;
+      live = segment_live (start, &s);
+      if (live >= 0 && live < victim_live)
+        {
+          victim = start;
+          victim_live = live;
+        }
+    }
+  if (victim_live > LFS_CLEAN_MAX_LIVE)
+    return false;
+
+  journal_begin ();
+  segment_live (victim, &s);
+  for (ofs = 1; ofs < LFS_SEGMENT_SECTORS; ofs++)
+    if (free_map_count_used (victim + ofs, 1) != 0)
+      inode_move_block (s.blocks[ofs - 1].inode, s.blocks[ofs - 1].idx);
+  free_map_release (victim, 1);
+  buffer_cache_discard (victim);
+  journal_end ();
+
+  /* Released sectors stay allocated until their release commits,
+     so commit now to hand the segment back to the log. */
+  journal_commit ();
+  return true;
+}
+
+/* Cleaner thread.  Runs whenever free segments run low, holding
+   the file system lock so that files do not change under it. */
+static void
+cleaner (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&clean_sema);
+#ifdef USERPROG
+      lock_acquire (&fileSys_lock);
+#endif
+      clean_requested = false;
+      while (count_free_segments () < LFS_CLEAN_MIN && clean_segment ())
+        continue;
+#ifdef USERPROG
+      lock_release (&fileSys_lock);
+#endif
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef FILESYS_LFS_H
+#define FILESYS_LFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Sectors per log segment, including its summary sector. */
+#define LFS_SEGMENT_SECTORS 64
+
+void lfs_init (bool format, bool enable);
+void lfs_flush (void);
+bool lfs_enabled (void);
+
+bool lfs_allocate (block_sector_t inode_sector, size_t idx,
+                   block_sector_t *sectorp);
+bool lfs_in_log_head (block_sector_t);
+
+#endif /* filesys/lfs.h */
@@ -0,0 +1,289 @@
+#include "filesys/pagecache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A cache of whole file pages, keyed by inode and page number.
+
+   Memory-mapped file pages are taken from here instead of being
+   copied into a private frame for each mapping, so every process
+   that maps the same page of a file shares one physical page, and
+   inode_read_at() serves reads of a cached page from the same
+   memory that the mappings see.  Pages are read in with
+   inode_read_direct(), so a mapped page is not also kept in the
+   buffer cache unless its sectors were already there.  Writes through inode_write_at()
+   are copied into a cached page as well, so the two views never
+   disagree.  Stores through a mapping still reach the disk when
+   the page is unmapped.
+
+   Only pages that are mapped, or were and have not been evicted
+   since, are cached: reads of files that were never mapped go
+   through the buffer cache alone and never touch this cache.  A page with no mappings is clean, because write-back
+   happens at unmap, so eviction simply reuses it. */
+
+/* A cached file page. */
+struct pagecache_entry
+  {
+    bool valid;                 /* Holds a file page? */
+    bool loading;               /* Being read in, contents not ready. */
+    bool stale;                 /* Written to while loading. */
+    bool accessed;              /* For the clock algorithm. */
+    block_sector_t inode;       /* Sector of the file's inode. */
+    size_t page;                /* Page number within the file. */
+    int map_cnt;                /* Number of user mappings. */
+    uint8_t *kpage;             /* Kernel page, allocated on first use. */
+  };
+
+static struct pagecache_entry entries[PAGECACHE_SIZE];
+static size_t valid_cnt;        /* Number of valid entries. */
+static size_t hand;             /* Clock hand. */
+
+/* Protects the entries.  Never held across a call into the inode
+   layer, which calls back into the page cache. */
+static struct lock pagecache_lock;
+
+/* Signaled when a page finishes loading. */
+static struct condition loaded;
+
+/* Initializes the page cache. */
+void
+pagecache_init (void)
+{
+  size_t i;
+
+  lock_init (&pagecache_lock);
+  cond_init (&loaded);
+  for (i = 0; i < PAGECACHE_SIZE; i++)
+    {
+      entries[i].valid = false;
+      entries[i].kpage = NULL;
+    }
+  valid_cnt = 0;
+  hand = 0;
+}
+
+/* Returns the entry for PAGE of the file whose inode is in
+   INODE_SECTOR, or a null pointer if it is not cached. */
+static struct pagecache_entry *
+lookup (block_sector_t inode_sector, size_t page)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&pagecache_lock));
+  for (i = 0; i < PAGECACHE_SIZE; i++)
+    if (entries[i].valid && entries[i].inode == inode_sector
+        && entries[i].page == page)
+      return &entries[i];
+  return NULL;
+}
+
+/* Returns an entry that can take a new page, evicting an unmapped
+   page if necessary, or a null pointer if every page is mapped or
+   no memory is left. */
+static struct pagecache_entry *
+get_free_entry (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&pagecache_lock));
+  for (i = 0; i < PAGECACHE_SIZE; i++)
+    if (!entries[i].valid)
+      {
+        if (entries[i].kpage == NULL)
+          {
+            entries[i].kpage = palloc_get_page (0);
+            if (entries[i].kpage == NULL)
+              break;
+          }
+        valid_cnt++;
+        return &entries[i];
+      }
+
+  /* Two sweeps clear every accessed bit, so a third finds a victim
+     if any page is unmapped. */
+  for (i = 0; i < 3 * PAGECACHE_SIZE; i++)
+    {
+      struct pagecache_entry *e = &entries[hand];
+      hand = (hand + 1) % PAGECACHE_SIZE;
+      if (!e->valid || e->loading || e->map_cnt > 0)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Maps page number PAGE of INODE: returns the kernel address of
+   its cached copy, reading it in if necessary, and counts a new
+   mapping of it.  Bytes past the end of the file read as zeros.
+   Returns a null pointer if the page cannot be cached, in which
+   case the caller should fall back to a private copy. */
+void *
+pagecache_map (struct inode *inode, size_t page)
+{
+  block_sector_t sector = inode_get_inumber (inode);
+  struct pagecache_entry *e;
+
+  lock_acquire (&pagecache_lock);
+  e = lookup (sector, page);
+  while (e != NULL && e->loading)
+    {
+      cond_wait (&loaded, &pagecache_lock);
+      e = lookup (sector, page);
+    }
+  if (e == NULL)
+    {
+      e = get_free_entry ();
+      if (e == NULL)
+        {
+          lock_release (&pagecache_lock);
+          return NULL;
+        }
+      e->valid = true;
+      e->loading = true;
+      e->inode = sector;
+      e->page = page;
+      e->map_cnt = 0;
+      do
+        {
+          e->stale = false;
+          lock_release (&pagecache_lock);
+
+          memset (e->kpage, 0, PGSIZE);
+          inode_read_direct (inode, e->kpage, PGSIZE,
+                             (off_t) page * PGSIZE);
+
+          lock_acquire (&pagecache_lock);
+        }
+      while (e->stale);
+      e->loading = false;
+      cond_broadcast (&loaded, &pagecache_lock);
+    }
+  e->map_cnt++;
+  e->accessed = true;
+  lock_release (&pagecache_lock);
+  return e->kpage;
+}
+
+/* Drops a mapping of the cached page at KPAGE, which was returned
+   by pagecache_map().  The page stays cached. */
+void
+pagecache_unmap (void *kpage)
+{
+  size_t i;
+
+  lock_acquire (&pagecache_lock);
+  for (i = 0; i < PAGECACHE_SIZE; i++)
+    if (entries[i].valid && entries[i].kpage == kpage)
+      {
+        ASSERT (entries[i].map_cnt > 0);
+        entries[i].map_cnt--;
+        break;
+      }
+  ASSERT (i < PAGECACHE_SIZE);
+  lock_release (&pagecache_lock);
+}
+
+/* Returns true if any page of the file whose inode is in
+   INODE_SECTOR is cached.  Lets the inode layer skip the page
+   cache entirely for files that are not mapped. */
+bool
+pagecache_in_use (block_sector_t inode_sector)
+{
+  bool found = false;
+  size_t i;
+
+  if (valid_cnt == 0)
+    return false;
+
+  lock_acquire (&pagecache_lock);
+  for (i = 0; i < PAGECACHE_SIZE && !found; i++)
+    found = entries[i].valid && entries[i].inode == inode_sector;
+  lock_release (&pagecache_lock);
+  return found;
+}
+
+/* If the page of the file whose inode is in INODE_SECTOR that
+   contains OFFSET is cached, copies SIZE bytes starting at OFFSET
+   from it into BUFFER and returns true.  Otherwise returns false.
+   The SIZE bytes must not cross a page boundary. */
+bool
+pagecache_read (block_sector_t inode_sector, off_t offset,
+                void *buffer, off_t size)
+{
+  struct pagecache_entry *e;
+
+  ASSERT (offset % PGSIZE + size <= PGSIZE);
+  if (valid_cnt == 0)
+    return false;
+
+  lock_acquire (&pagecache_lock);
+  e = lookup (inode_sector, offset / PGSIZE);
+  if (e != NULL && !e->loading)
+    {
+      memcpy (buffer, e->kpage + offset % PGSIZE, size);
+      e->accessed = true;
+    }
+  else
+    e = NULL;
+  lock_release (&pagecache_lock);
+  return e != NULL;
+}
+
+/* Copies SIZE bytes from BUFFER into whichever cached pages of the
+   file whose inode is in INODE_SECTOR they were just written to at
+   OFFSET. */
+void
+pagecache_write (block_sector_t inode_sector, off_t offset,
+                 const void *buffer_, off_t size)
+{
+  const uint8_t *buffer = buffer_;
+
+  if (valid_cnt == 0)
+    return;
+
+  lock_acquire (&pagecache_lock);
+  while (size > 0)
+    {
+      struct pagecache_entry *e = lookup (inode_sector, offset / PGSIZE);
+      int page_ofs = offset % PGSIZE;
+      off_t chunk_size = PGSIZE - page_ofs < size ? PGSIZE - page_ofs : size;
+
+      /* A page still loading is read in again afterward. */
+      if (e != NULL && e->loading)
+        e->stale = true;
+      else if (e != NULL)
+        memmove (e->kpage + page_ofs, buffer, chunk_size);
+
+      size -= chunk_size;
+      offset += chunk_size;
+      buffer += chunk_size;
+    }
+  lock_release (&pagecache_lock);
+}
+
+/* Drops every cached page of the file whose inode is in
+   INODE_SECTOR, which is being deleted. */
+void
+pagecache_purge (block_sector_t inode_sector)
+{
+  size_t i;
+
+  if (valid_cnt == 0)
+    return;
+
+  lock_acquire (&pagecache_lock);
+  for (i = 0; i < PAGECACHE_SIZE; i++)
+    if (entries[i].valid && entries[i].inode == inode_sector)
+      {
+        ASSERT (entries[i].map_cnt == 0 && !entries[i].loading);
+        entries[i].valid = false;
+        valid_cnt--;
+      }
+  lock_release (&pagecache_lock);
+}
@@ -0,0 +1,25 @@
+#ifndef FILESYS_PAGECACHE_H
+#define FILESYS_PAGECACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+struct inode;
+
+/* Number of file pages the page cache can hold. */
+#define PAGECACHE_SIZE 32
+
+void pagecache_init (void);
+void *pagecache_map (struct inode *, size_t page);
+void pagecache_unmap (void *kpage);
+
+bool pagecache_in_use (block_sector_t inode_sector);
+bool pagecache_read (block_sector_t inode_sector, off_t offset,
+                     void *buffer, off_t size);
+void pagecache_write (block_sector_t inode_sector, off_t offset,
+                      const void *buffer, off_t size);
+void pagecache_purge (block_sector_t inode_sector);
+
+#endif /* filesys/pagecache.h */
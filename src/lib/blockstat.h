@@ -0,0 +1,41 @@
+#ifndef __LIB_BLOCKSTAT_H
+#define __LIB_BLOCKSTAT_H
+
+/* Block device statistics returned by the blockstat system call.
+   Shared between the kernel and user programs.
+
+   Times are in CPU time-stamp counter cycles. */
+
+/* Latency histogram buckets.  Bucket 0 counts latencies under
+   2**BLOCK_LATENCY_SHIFT cycles, bucket I > 0 those from
+   2**(BLOCK_LATENCY_SHIFT + I - 1) up to twice that, and the last
+   bucket also everything longer. */
+#define BLOCK_LATENCY_SHIFT 12
+#define BLOCK_LATENCY_BUCKETS 24
+
+/* Statistics for requests in one direction. */
+struct block_op_stats
+  {
+    unsigned long long requests;        /* Requests completed. */
+    unsigned long long bytes;           /* Bytes they transferred. */
+    unsigned long long latency;         /* Sum of their latencies. */
+    unsigned long long max_latency;     /* Longest latency. */
+    unsigned latency_hist[BLOCK_LATENCY_BUCKETS];
+  };
+
+/* Statistics for one block device. */
+struct block_stats
+  {
+    struct block_op_stats read;         /* Reads. */
+    struct block_op_stats write;        /* Writes. */
+    unsigned depth;                     /* Requests now in flight. */
+    unsigned max_depth;                 /* Most requests ever in flight. */
+    unsigned long long busy;            /* Time with requests in flight. */
+    unsigned long long elapsed;         /* Time since registration. */
+    unsigned long long throttled;       /* Requests deferred to let
+                                           other devices on the same
+                                           disk have their share. */
+    unsigned weight;                    /* Share of the disk. */
+  };
+
+#endif /* lib/blockstat.h */
@@ -0,0 +1,21 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Directory entry format returned by the getdents system call.
+   Shared between the kernel and user programs. */
+
+#include <stdbool.h>
+
+/* Maximum length of a name in a struct dirent, not counting the
+   null terminator.  Matches NAME_MAX in the file system. */
+#define DIRENT_NAME_MAX 14
+
+/* One directory entry. */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* True if a directory. */
+    char name[DIRENT_NAME_MAX + 1];     /* Null terminated file name. */
+  };
+
+#endif /* lib/dirent.h */
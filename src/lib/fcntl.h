@@ -0,0 +1,15 @@
+#ifndef __LIB_FCNTL_H
+#define __LIB_FCNTL_H
+
+/* Flags for the open_flags system call.
+   Shared between the kernel and user programs. */
+
+/* Move whole sectors straight between the caller's buffer and the
+   disk, bypassing the buffer cache. */
+#define O_DIRECT 0x1
+
+/* Give the file the compressed attribute, which is kept with it:
+   its data is stored compressed from when it is next closed. */
+#define O_COMPRESS 0x2
+
+#endif /* lib/fcntl.h */
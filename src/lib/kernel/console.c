@@ -152,9 +152,13 @@ puts (const char *s)
 void
 putbuf (const char *buffer, size_t n) 
 {
+  size_t i;
+
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  write_cnt += n;
+  serial_putbuf ((const uint8_t *) buffer, n);
+  for (i = 0; i < n; i++)
+    vga_putc (buffer[i]);
   release_console ();
 }
 
@@ -0,0 +1,156 @@
+#include <lz.h>
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Compressed format.  A sequence of items, each starting with a
+   control byte C:
+
+     C < 32: a literal run of C + 1 bytes, which follow.
+
+     C >= 32: a back-reference.  L = C >> 5 is the match length
+     minus 2, and if it is 7, the next byte is added to it.  The
+     next byte, with the low 5 bits of C above it, is the distance
+     back to the match minus 1. */
+
+/* Longest literal run. */
+#define MAX_LIT 32
+
+/* Farthest back-reference. */
+#define MAX_OFF (1 << 13)
+
+/* Longest back-reference. */
+#define MAX_REF (2 + 7 + 255)
+
+/* Returns the hash table slot for the 3 bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  unsigned v = (p[0] << 16) | (p[1] << 8) | p[2];
+  return (v * 2654435761u) >> 22;
+}
+
+/* Appends the literal bytes SRC[START...END) to DST at *OP, in runs
+   of up to MAX_LIT.  Returns false if DST_SIZE bytes do not
+   suffice. */
+static bool
+put_literals (const uint8_t *src, size_t start, size_t end,
+              uint8_t *dst, size_t *op, size_t dst_size)
+{
+  while (start < end)
+    {
+      size_t n = end - start < MAX_LIT ? end - start : MAX_LIT;
+      if (*op + 1 + n > dst_size)
+        return false;
+      dst[(*op)++] = n - 1;
+      memcpy (dst + *op, src + start, n);
+      *op += n;
+      start += n;
+    }
+  return true;
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into DST, which has room
+   for DST_SIZE bytes, using TABLE, an array of LZ_TABLE_SIZE
+   elements, as scratch space.  Returns the compressed size, or 0
+   if it would exceed DST_SIZE. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, uint16_t *table)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0, op = 0, lit = 0;
+
+  ASSERT (src_size < UINT16_MAX);
+  ASSERT (LZ_TABLE_SIZE == 1 << 10);
+
+  /* Each slot holds a position plus 1, or 0 if empty. */
+  memset (table, 0, LZ_TABLE_SIZE * sizeof *table);
+  while (ip + 2 < src_size)
+    {
+      unsigned h = hash3 (src + ip);
+      size_t ref = table[h];
+
+      table[h] = ip + 1;
+      if (ref-- != 0 && ip - ref <= MAX_OFF
+          && src[ref] == src[ip] && src[ref + 1] == src[ip + 1]
+          && src[ref + 2] == src[ip + 2])
+        {
+          size_t max = src_size - ip < MAX_REF ? src_size - ip : MAX_REF;
+          size_t len = 3, dist = ip - ref - 1;
+
+          while (len < max && src[ref + len] == src[ip + len])
+            len++;
+          if (!put_literals (src, lit, ip, dst, &op, dst_size)
+              || op + 3 > dst_size)
+            return 0;
+          if (len - 2 < 7)
+            dst[op++] = ((len - 2) << 5) | (dist >> 8);
+          else
+            {
+              dst[op++] = (7 << 5) | (dist >> 8);
+              dst[op++] = len - 2 - 7;
+            }
+          dst[op++] = dist & 0xff;
+          ip += len;
+          lit = ip;
+        }
+      else
+        ip++;
+    }
+
+  if (!put_literals (src, lit, src_size, dst, &op, dst_size))
+    return 0;
+  return op;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   lz_compress(), into DST, which has room for DST_SIZE bytes.
+   Returns the decompressed size, or 0 if SRC is corrupt or its
+   contents do not fit. */
+size_t
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t ip = 0, op = 0;
+
+  while (ip < src_size)
+    {
+      unsigned c = src[ip++];
+
+      if (c < MAX_LIT)
+        {
+          size_t n = c + 1;
+          if (ip + n > src_size || op + n > dst_size)
+            return 0;
+          memcpy (dst + op, src + ip, n);
+          ip += n;
+          op += n;
+        }
+      else
+        {
+          size_t len = c >> 5, dist, i;
+
+          if (len == 7)
+            {
+              if (ip >= src_size)
+                return 0;
+              len += src[ip++];
+            }
+          len += 2;
+          if (ip >= src_size)
+            return 0;
+          dist = ((c & 0x1f) << 8) | src[ip++];
+          if (dist >= op || op + len > dst_size)
+            return 0;
+
+          /* The match may overlap the bytes being produced. */
+          for (i = 0; i < len; i++, op++)
+            dst[op] = dst[op - dist - 1];
+        }
+    }
+  return op;
+}
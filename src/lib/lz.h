@@ -0,0 +1,18 @@
+#ifndef __LIB_LZ_H
+#define __LIB_LZ_H
+
+/* A small, fast LZ77 compressor in the style of LZF, for blocks
+   of up to 64 kB.  Favors speed over compression ratio. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entries in the hash table that lz_compress() works in. */
+#define LZ_TABLE_SIZE 1024
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size, uint16_t *table);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_size);
+
+#endif /* lib/lz.h */
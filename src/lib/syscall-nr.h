@@ -28,7 +28,16 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+    SYS_FSYNC,                  /* Writes a file's cached data to disk. */
+    SYS_SYNC,                   /* Writes all cached data to disk. */
+    SYS_OPEN_FLAGS,             /* Open a file with O_* flags. */
+    SYS_DEFRAG,                 /* Makes a file's data contiguous on disk. */
+    SYS_COPY_FILE_RANGE,        /* Copies data between files in the kernel. */
+    SYS_PREAD,                  /* Reads from a file at a given offset. */
+    SYS_PWRITE,                 /* Writes to a file at a given offset. */
+    SYS_BLOCKSTAT               /* Reads block device statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
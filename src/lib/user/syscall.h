@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <blockstat.h>
+#include <dirent.h>
+#include <fcntl.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -44,5 +47,14 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int getdents (int fd, struct dirent *, unsigned cnt);
+bool fsync (int fd);
+void sync (void);
+int open_flags (const char *file, int flags);
+bool defrag (int fd);
+int copy_file_range (int in_fd, int out_fd, unsigned size);
+int pread (int fd, void *, unsigned size, unsigned offset);
+int pwrite (int fd, const void *, unsigned size, unsigned offset);
+bool blockstat (const char *device, struct block_stats *);
 
 #endif /* lib/user/syscall.h */
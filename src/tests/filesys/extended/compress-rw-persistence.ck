@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = join ('', map (chr (ord ('a') + int ($_ / 100) % 8),
+                            0 .. 12 * 4096 + 300 - 1));
+substr ($data, 5000, 3000) = 'z' x 3000;
+check_archive ({"packed" => [$data]});
+pass;
@@ -0,0 +1,40 @@
+/* Writes a compressible file through a descriptor opened with
+   O_COMPRESS, verifies it after it is closed and compressed,
+   rewrites part of it, and verifies it again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE (12 * 4096 + 300)
+static char buf[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  size_t i;
+  int fd;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i / 100 % 8;
+  CHECK (create ("packed", 0), "create \"packed\"");
+  CHECK ((fd = open_flags ("packed", O_COMPRESS)) > 1,
+         "open \"packed\" with O_COMPRESS");
+  CHECK (write (fd, buf, sizeof buf) == TEST_SIZE, "write \"packed\"");
+  msg ("close \"packed\"");
+  close (fd);
+  check_file ("packed", buf, sizeof buf);
+
+  memset (buf + 5000, 'z', 3000);
+  CHECK ((fd = open ("packed")) > 1, "open \"packed\"");
+  msg ("seek \"packed\" to 5000");
+  seek (fd, 5000);
+  CHECK (write (fd, buf + 5000, 3000) == 3000, "rewrite part of \"packed\"");
+  msg ("close \"packed\"");
+  close (fd);
+  check_file ("packed", buf, sizeof buf);
+
+  CHECK (open_flags ("/", O_COMPRESS) == -1,
+         "open directory with O_COMPRESS (must return -1)");
+}
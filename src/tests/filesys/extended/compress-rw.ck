@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(compress-rw) begin
+(compress-rw) create "packed"
+(compress-rw) open "packed" with O_COMPRESS
+(compress-rw) write "packed"
+(compress-rw) close "packed"
+(compress-rw) open "packed" for verification
+(compress-rw) verified contents of "packed"
+(compress-rw) close "packed"
+(compress-rw) open "packed"
+(compress-rw) seek "packed" to 5000
+(compress-rw) rewrite part of "packed"
+(compress-rw) close "packed"
+(compress-rw) open "packed" for verification
+(compress-rw) verified contents of "packed"
+(compress-rw) close "packed"
+(compress-rw) open directory with O_COMPRESS (must return -1)
+(compress-rw) end
+compress-rw: exit(0)
+EOF
+pass;
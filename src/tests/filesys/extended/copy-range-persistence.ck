@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($src) = random_bytes (6000);
+check_archive ({"src" => [$src], "dst" => [substr ($src, 100)]});
+pass;
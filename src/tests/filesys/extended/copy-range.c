@@ -0,0 +1,41 @@
+/* Copies most of a file into a new one with copy_file_range,
+   starting at an unaligned position and running past the end of
+   the source, then verifies the copy. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 6000
+static char buf[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  int src, dst;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK (write (src, buf, sizeof buf) == TEST_SIZE, "write \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+
+  msg ("seek \"src\" to 100");
+  seek (src, 100);
+  CHECK (copy_file_range (src, dst, 5000) == 5000,
+         "copy 5000 bytes from \"src\" to \"dst\"");
+  CHECK (copy_file_range (src, dst, 5000) == TEST_SIZE - 5100,
+         "copy the rest of \"src\" to \"dst\"");
+  CHECK (copy_file_range (src, dst, 5000) == 0,
+         "copy at end of \"src\" (must return 0)");
+  CHECK (copy_file_range (src, 100, 1) == -1,
+         "copy to bad fd (must return -1)");
+  msg ("close \"src\"");
+  close (src);
+  msg ("close \"dst\"");
+  close (dst);
+
+  check_file ("dst", buf + 100, TEST_SIZE - 100);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range) begin
+(copy-range) create "src"
+(copy-range) open "src"
+(copy-range) write "src"
+(copy-range) create "dst"
+(copy-range) open "dst"
+(copy-range) seek "src" to 100
+(copy-range) copy 5000 bytes from "src" to "dst"
+(copy-range) copy the rest of "src" to "dst"
+(copy-range) copy at end of "src" (must return 0)
+(copy-range) copy to bad fd (must return -1)
+(copy-range) close "src"
+(copy-range) close "dst"
+(copy-range) open "dst" for verification
+(copy-range) verified contents of "dst"
+(copy-range) close "dst"
+(copy-range) end
+copy-range: exit(0)
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($a) = join ('', map (chr (int ($_ / 512)), 0 .. 40 * 512 - 1));
+my ($b) = join ('', map (chr (255 - int ($_ / 512)), 0 .. 40 * 512 - 1));
+check_archive ({"a" => [$a], "b" => [$b]});
+pass;
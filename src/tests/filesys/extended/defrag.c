@@ -0,0 +1,42 @@
+/* Grows two files a sector at a time, in turn, so that their
+   sectors interleave on disk, then defragments one of them and
+   verifies both. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTOR_CNT 40
+#define TEST_SIZE (SECTOR_CNT * 512)
+static char buf_a[TEST_SIZE];
+static char buf_b[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+  size_t i;
+
+  for (i = 0; i < TEST_SIZE; i++)
+    {
+      buf_a[i] = i / 512;
+      buf_b[i] = 255 - i / 512;
+    }
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+  msg ("write \"a\" and \"b\" alternately");
+  for (i = 0; i < SECTOR_CNT; i++)
+    if (write (fd_a, buf_a + i * 512, 512) != 512
+        || write (fd_b, buf_b + i * 512, 512) != 512)
+      fail ("write failed at sector %zu", i);
+  CHECK (defrag (fd_a), "defrag \"a\"");
+  CHECK (defrag (fd_a), "defrag \"a\" again");
+  msg ("close \"a\"");
+  close (fd_a);
+  msg ("close \"b\"");
+  close (fd_b);
+  check_file ("a", buf_a, sizeof buf_a);
+  check_file ("b", buf_b, sizeof buf_b);
+}
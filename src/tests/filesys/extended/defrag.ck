@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(defrag) begin
+(defrag) create "a"
+(defrag) create "b"
+(defrag) open "a"
+(defrag) open "b"
+(defrag) write "a" and "b" alternately
+(defrag) defrag "a"
+(defrag) defrag "a" again
+(defrag) close "a"
+(defrag) close "b"
+(defrag) open "a" for verification
+(defrag) verified contents of "a"
+(defrag) close "a"
+(defrag) open "b" for verification
+(defrag) verified contents of "b"
+(defrag) close "b"
+(defrag) end
+defrag: exit(0)
+EOF
+pass;
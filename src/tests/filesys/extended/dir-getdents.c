@@ -0,0 +1,71 @@
+/* Creates a directory holding several files and a subdirectory,
+   then reads all of its entries back with getdents(), a few at
+   a time, checking names, types, and inode numbers. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10
+
+void
+test_main (void) 
+{
+  struct dirent entries[4];
+  bool seen[FILE_CNT + 1];
+  int dir_fd, cnt, total, i;
+
+  CHECK (mkdir ("/d"), "mkdir \"/d\"");
+  CHECK (mkdir ("/d/sub"), "mkdir \"/d/sub\"");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[READDIR_MAX_LEN + 1];
+      snprintf (name, sizeof name, "/d/f%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  CHECK ((dir_fd = open ("/d")) > 1, "open \"/d\"");
+
+  msg ("read entries with getdents");
+  memset (seen, 0, sizeof seen);
+  total = 0;
+  while ((cnt = getdents (dir_fd, entries, 4)) > 0)
+    {
+      if (cnt > 4)
+        fail ("getdents returned %d entries, asked for 4", cnt);
+      for (i = 0; i < cnt; i++)
+        {
+          struct dirent *e = &entries[i];
+          int idx;
+
+          if (!strcmp (e->name, "sub"))
+            {
+              if (!e->is_dir)
+                fail ("\"sub\" not reported as a directory");
+              idx = FILE_CNT;
+            }
+          else if (e->name[0] == 'f')
+            {
+              idx = atoi (e->name + 1);
+              if (e->is_dir)
+                fail ("\"%s\" reported as a directory", e->name);
+            }
+          else
+            fail ("unexpected entry \"%s\"", e->name);
+
+          if (seen[idx])
+            fail ("entry \"%s\" returned twice", e->name);
+          seen[idx] = true;
+          if (e->inumber <= 1)
+            fail ("entry \"%s\" has bogus inumber %d", e->name, e->inumber);
+          total++;
+        }
+    }
+  CHECK (cnt == 0, "getdents at end of directory returns 0");
+  CHECK (total == FILE_CNT + 1, "found %d entries", total);
+  CHECK (getdents (dir_fd, entries, 4) == 0,
+         "getdents after end still returns 0");
+  close (dir_fd);
+}
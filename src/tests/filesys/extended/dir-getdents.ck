@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "/d"
+(dir-getdents) mkdir "/d/sub"
+(dir-getdents) create "/d/f0"
+(dir-getdents) create "/d/f1"
+(dir-getdents) create "/d/f2"
+(dir-getdents) create "/d/f3"
+(dir-getdents) create "/d/f4"
+(dir-getdents) create "/d/f5"
+(dir-getdents) create "/d/f6"
+(dir-getdents) create "/d/f7"
+(dir-getdents) create "/d/f8"
+(dir-getdents) create "/d/f9"
+(dir-getdents) open "/d"
+(dir-getdents) read entries with getdents
+(dir-getdents) getdents at end of directory returns 0
+(dir-getdents) found 11 entries
+(dir-getdents) getdents after end still returns 0
+(dir-getdents) end
+dir-getdents: exit(0)
+EOF
+pass;
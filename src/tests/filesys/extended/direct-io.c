@@ -0,0 +1,35 @@
+/* Writes a file through a descriptor opened with O_DIRECT, both
+   whole sectors and a partial tail, reads it back the same way,
+   then verifies it through an ordinary descriptor. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE (16 * 512 + 100)
+static char buf[TEST_SIZE];
+static char back[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("direct", 0), "create \"direct\"");
+  CHECK ((fd = open_flags ("direct", O_DIRECT)) > 1,
+         "open \"direct\" with O_DIRECT");
+  CHECK (write (fd, buf, sizeof buf) == TEST_SIZE, "write \"direct\"");
+  msg ("seek \"direct\" to 0");
+  seek (fd, 0);
+  CHECK (read (fd, back, sizeof back) == TEST_SIZE, "read \"direct\"");
+  if (memcmp (buf, back, sizeof buf))
+    fail ("data read back differs from data written");
+  msg ("close \"direct\"");
+  close (fd);
+  CHECK (open_flags ("direct", 0x100) == -1,
+         "open with unknown flag (must return -1)");
+  check_file ("direct", buf, sizeof buf);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(direct-io) begin
+(direct-io) create "direct"
+(direct-io) open "direct" with O_DIRECT
+(direct-io) write "direct"
+(direct-io) seek "direct" to 0
+(direct-io) read "direct"
+(direct-io) close "direct"
+(direct-io) open with unknown flag (must return -1)
+(direct-io) open "direct" for verification
+(direct-io) verified contents of "direct"
+(direct-io) close "direct"
+(direct-io) end
+direct-io: exit(0)
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Writes and reads back blocks of a file at scattered offsets with
+   pwrite and pread, checking that neither moves the file
+   position. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 6000
+static char buf[TEST_SIZE];
+static char buf2[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  static const unsigned offsets[] = {4000, 0, 2500, 1000, 5500, 500};
+  const size_t block = 500;
+  size_t i;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  msg ("pwrite blocks at scattered offsets");
+  for (i = 0; i < sizeof offsets / sizeof *offsets; i++)
+    if (pwrite (fd, buf + offsets[i], block, offsets[i]) != (int) block)
+      fail ("pwrite %zu bytes at offset %u failed", block, offsets[i]);
+  CHECK (tell (fd) == 0, "file position unchanged by pwrite");
+
+  msg ("pread blocks back");
+  for (i = 0; i < sizeof offsets / sizeof *offsets; i++)
+    {
+      if (pread (fd, buf2, block, offsets[i]) != (int) block)
+        fail ("pread %zu bytes at offset %u failed", block, offsets[i]);
+      if (memcmp (buf2, buf + offsets[i], block))
+        fail ("data read at offset %u differs from data written",
+              offsets[i]);
+    }
+  CHECK (tell (fd) == 0, "file position unchanged by pread");
+  CHECK (pread (fd, buf2, block, TEST_SIZE) == 0,
+         "pread at end of file (must return 0)");
+  CHECK (pread (100, buf2, block, 0) == -1,
+         "pread from bad fd (must return -1)");
+  msg ("close \"data\"");
+  close (fd);
+}
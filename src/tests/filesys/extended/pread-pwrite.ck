@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "data"
+(pread-pwrite) open "data"
+(pread-pwrite) pwrite blocks at scattered offsets
+(pread-pwrite) file position unchanged by pwrite
+(pread-pwrite) pread blocks back
+(pread-pwrite) file position unchanged by pread
+(pread-pwrite) pread at end of file (must return 0)
+(pread-pwrite) pread from bad fd (must return -1)
+(pread-pwrite) close "data"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
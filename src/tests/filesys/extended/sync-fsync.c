@@ -0,0 +1,31 @@
+/* Writes a file, forces it to disk with fsync(), then flushes
+   the whole cache with sync().  This only checks the calls'
+   interfaces and that the data reads back.  The persistence
+   check runs after a clean shutdown, which flushes the cache on
+   its own, so neither test can tell whether fsync() or sync()
+   actually wrote anything early. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "Durable data, written back by fsync.\n";
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, data, sizeof data - 1) == (int) sizeof data - 1,
+         "write \"data\"");
+  CHECK (fsync (fd), "fsync \"data\"");
+  CHECK (!fsync (fd + 100), "fsync bad fd (must return false)");
+  msg ("sync");
+  sync ();
+  msg ("close \"data\"");
+  close (fd);
+  check_file ("data", data, sizeof data - 1);
+}
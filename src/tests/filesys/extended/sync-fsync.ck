@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sync-fsync) begin
+(sync-fsync) create "data"
+(sync-fsync) open "data"
+(sync-fsync) write "data"
+(sync-fsync) fsync "data"
+(sync-fsync) fsync bad fd (must return false)
+(sync-fsync) sync
+(sync-fsync) close "data"
+(sync-fsync) open "data" for verification
+(sync-fsync) verified contents of "data"
+(sync-fsync) close "data"
+(sync-fsync) end
+sync-fsync: exit(0)
+EOF
+pass;
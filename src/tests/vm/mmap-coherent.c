@@ -0,0 +1,48 @@
+/* Checks that mappings of a file, and the read and write system
+   calls on it, all see the same data without unmapping first. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define ACTUAL2 ((char *) 0x20000000)
+
+void
+test_main (void)
+{
+  static const char update[] = "rewritten";
+  int handle;
+  mapid_t map, map2;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK ((map2 = mmap (handle, ACTUAL2)) != MAP_FAILED,
+         "mmap \"sample.txt\" again");
+
+  /* Store through one mapping, see it through the other. */
+  memcpy (ACTUAL, sample, strlen (sample));
+  if (memcmp (ACTUAL2, sample, strlen (sample)))
+    fail ("second mapping does not see stores through the first");
+
+  /* Read the stores back while still mapped. */
+  read (handle, buf, strlen (sample));
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against mapped data");
+
+  /* Write the file, see it through the mappings. */
+  seek (handle, 0);
+  CHECK (write (handle, update, sizeof update - 1) == sizeof update - 1,
+         "write \"sample.txt\"");
+  if (memcmp (ACTUAL, update, sizeof update - 1)
+      || memcmp (ACTUAL2, update, sizeof update - 1))
+    fail ("mappings do not see data written to the file");
+
+  munmap (map);
+  munmap (map2);
+  close (handle);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-coherent) begin
+(mmap-coherent) create "sample.txt"
+(mmap-coherent) open "sample.txt"
+(mmap-coherent) mmap "sample.txt"
+(mmap-coherent) mmap "sample.txt" again
+(mmap-coherent) compare read data against mapped data
+(mmap-coherent) write "sample.txt"
+(mmap-coherent) end
+EOF
+pass;
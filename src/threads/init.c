@@ -40,6 +40,8 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -51,6 +53,9 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -lfs: Format it in log-structured write mode? */
+static bool format_lfs;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
@@ -58,6 +63,11 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Size of RAM disk to create, in kB, or 0 for none.
+   -ramdisk-load: Preload it from the scratch device? */
+static size_t ramdisk_kb;
+static bool ramdisk_load_scratch;
 #endif /* FILESYS */
 
 #ifdef VM
@@ -137,8 +147,13 @@ pintos_init (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  if (ramdisk_kb > 0)
+    ramdisk_init (ramdisk_kb);
   locate_block_devices ();
-  filesys_init (format_filesys);
+  if (ramdisk_load_scratch)
+    ramdisk_load ();
+  filesys_init (format_filesys, format_lfs);
 #endif
 #ifdef VM
     vm_swap_init ();
@@ -263,10 +278,32 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-lfs"))
+        format_lfs = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        {
+          ramdisk_kb = value != NULL ? atoi (value) : 0;
+          if (ramdisk_kb == 0)
+            PANIC ("bad RAM disk size `%s'", value);
+        }
+      else if (!strcmp (name, "-ramdisk-load"))
+        ramdisk_load_scratch = true;
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !block_set_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s'", value);
+        }
+      else if (!strcmp (name, "-ioweight"))
+        {
+          char *role = value != NULL ? strtok_r (value, ":", &save_ptr) : NULL;
+          char *weight = role != NULL ? strtok_r (NULL, "", &save_ptr) : NULL;
+          if (weight == NULL || !block_set_weight (role, atoi (weight)))
+            PANIC ("bad I/O weight `%s'", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -391,8 +428,14 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -lfs               With -f, format in log-structured write mode.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ramdisk=KB        Create a KB kB RAM disk, named ram0, mostly from\n"
+          "                     the user pool.\n"
+          "  -ramdisk-load      Preload the RAM disk from the scratch device.\n"
+          "  -iosched=NAME      Use I/O scheduler NAME: fifo, clook, deadline.\n"
+          "  -ioweight=ROLE:W   Give ROLE's device weight W in sharing a disk.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
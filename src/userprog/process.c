@@ -217,13 +217,17 @@ process_exit (void)
   uint32_t *pd;
 
   // free resources, file structrue
+  // closing the last opener of a file may compress it, so hold the
+  // file system lock as the close system call does
   struct list *opend_files = &cur->opened_files;
+  lock_acquire(&fileSys_lock);
   while (!list_empty(opend_files)) {
     struct list_elem *elem = list_pop_front(opend_files);
     struct file_descriptor *fileD = list_entry(elem, struct file_descriptor, elem);
     file_close(fileD->file);
     palloc_free_page(fileD);
   }
+  lock_release(&fileSys_lock);
 
  #ifdef VM
   //mmap desc
@@ -252,8 +256,10 @@ process_exit (void)
 
   // free executing_file
   if (cur->executing_file) {
+    lock_acquire(&fileSys_lock);
     file_allow_write(cur->executing_file);
     file_close(cur->executing_file);
+    lock_release(&fileSys_lock);
   }
 
   cur->pcb->exited = true;
@@ -1,15 +1,23 @@
 #include "userprog/syscall.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <blockstat.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "devices/block.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "lib/stdio.h"
 
 #include "userprog/process.h"
@@ -24,6 +32,12 @@ bool sys_mkdir(const char *name);
 bool sys_readdir(int fd, char *name);
 bool sys_isdir(int fd);
 int sys_inumber(int fd);
+int sys_getdents(int fd, struct dirent *entries, unsigned cnt);
+bool sys_fsync(int fd);
+void sys_sync(void);
+bool sys_defrag(int fd);
+int sys_copy_file_range(int in_fd, int out_fd, unsigned size);
+bool sys_blockstat(const char *device, struct block_stats *stats);
 #endif
 
 static void syscall_handler (struct intr_frame *);
@@ -37,9 +51,11 @@ static pid_t sys_exec(const char *cmd_line);
 static int sys_wait (pid_t pid);
 static bool sys_create (const char *file, unsigned initial_size);
 static bool sys_remove(const char* file);
-static int sys_open(const char* file);
+static int sys_open(const char* file, int flags);
 static int sys_filesize(int fd);
 static int sys_read(int fd, void *buffer, unsigned size);
+static int sys_pread(int fd, void *buffer, unsigned size, unsigned offset);
+static int sys_pwrite(int fd, const void *buffer, unsigned size, unsigned offset);
 static void sys_seek(int fd, unsigned position);
 static unsigned sys_tell(int fd);
 static void sys_close(int fd);
@@ -164,7 +180,19 @@ syscall_handler (struct intr_frame *f UNUSED)
       char* file;
       int res;
       mem_read(f->esp+4, &file, sizeof(file));
-      res = sys_open(file);
+      res = sys_open(file, 0);
+      f->eax = res;
+      break;
+    }
+
+    case SYS_OPEN_FLAGS:
+    {
+      char* file;
+      int flags;
+      int res;
+      mem_read(f->esp + 4, &file, sizeof(file));
+      mem_read(f->esp + 8, &flags, sizeof(flags));
+      res = sys_open(file, flags);
       f->eax = res;
       break;
     }
@@ -193,6 +221,32 @@ syscall_handler (struct intr_frame *f UNUSED)
       break;
     }
 
+    case SYS_PREAD:
+    {
+      int fd;
+      void *buffer;
+      unsigned size, offset;
+      mem_read(f->esp + 4, &fd, sizeof(fd));
+      mem_read(f->esp + 8, &buffer, sizeof(buffer));
+      mem_read(f->esp + 12, &size, sizeof(size));
+      mem_read(f->esp + 16, &offset, sizeof(offset));
+      f->eax = sys_pread(fd, buffer, size, offset);
+      break;
+    }
+
+    case SYS_PWRITE:
+    {
+      int fd;
+      const void *buffer;
+      unsigned size, offset;
+      mem_read(f->esp + 4, &fd, sizeof(fd));
+      mem_read(f->esp + 8, &buffer, sizeof(buffer));
+      mem_read(f->esp + 12, &size, sizeof(size));
+      mem_read(f->esp + 16, &offset, sizeof(offset));
+      f->eax = sys_pwrite(fd, buffer, size, offset);
+      break;
+    }
+
     case SYS_WRITE:
     {
       int fd;
@@ -294,6 +348,55 @@ syscall_handler (struct intr_frame *f UNUSED)
       f->eax = sys_inumber(fd);
       break;
     }
+    case SYS_GETDENTS:
+    {
+      int fd;
+      struct dirent *entries;
+      unsigned cnt;
+      mem_read(f->esp + 4, &fd, sizeof(fd));
+      mem_read(f->esp + 8, &entries, sizeof(entries));
+      mem_read(f->esp + 12, &cnt, sizeof(cnt));
+      f->eax = sys_getdents(fd, entries, cnt);
+      break;
+    }
+    case SYS_FSYNC:
+    {
+      int fd;
+      mem_read(f->esp + 4, &fd, sizeof(fd));
+      f->eax = sys_fsync(fd);
+      break;
+    }
+    case SYS_SYNC:
+    {
+      sys_sync();
+      break;
+    }
+    case SYS_DEFRAG:
+    {
+      int fd;
+      mem_read(f->esp + 4, &fd, sizeof(fd));
+      f->eax = sys_defrag(fd);
+      break;
+    }
+    case SYS_COPY_FILE_RANGE:
+    {
+      int in_fd, out_fd;
+      unsigned size;
+      mem_read(f->esp + 4, &in_fd, sizeof(in_fd));
+      mem_read(f->esp + 8, &out_fd, sizeof(out_fd));
+      mem_read(f->esp + 12, &size, sizeof(size));
+      f->eax = sys_copy_file_range(in_fd, out_fd, size);
+      break;
+    }
+    case SYS_BLOCKSTAT:
+    {
+      const char *device;
+      struct block_stats *stats;
+      mem_read(f->esp + 4, &device, sizeof(device));
+      mem_read(f->esp + 8, &stats, sizeof(stats));
+      f->eax = sys_blockstat(device, stats);
+      break;
+    }
 #endif
     default:
       printf("[ERROR], forget add something!\n");
@@ -339,24 +442,24 @@ sys_write(int fd, const void *buffer, unsigned size) {
   check_valid_ptr((const uint8_t*) buffer);
   check_valid_ptr((const uint8_t*) buffer + size - 1);
 
-  lock_acquire (&fileSys_lock);
-  int res = -1;
-  if(fd == 1) { // stdout
+  // stdout does not touch the file system, so don't make it wait
+  if(fd == 1) {
     putbuf(buffer, size);
-    res = size;
+    return size;
   }
-  else { // file
-    struct file_descriptor* file = get_file_descriptor(thread_current(), fd, 1);
-    if (file && file->file) //file should be opened by cur thread
-    {
+
+  lock_acquire (&fileSys_lock);
+  int res = -1;
+  struct file_descriptor* file = get_file_descriptor(thread_current(), fd, 1);
+  if (file && file->file) //file should be opened by cur thread
+  {
 #ifdef VM
-        preload_pin_pages(buffer, size);
+      preload_pin_pages(buffer, size);
 #endif
-        res = file_write(file->file, buffer, size);
+      res = file_write(file->file, buffer, size);
 #ifdef VM
-        preload_unpin_pages(buffer, size);
+      preload_unpin_pages(buffer, size);
 #endif
-    }
   }
   lock_release (&fileSys_lock);
   return res;
@@ -388,9 +491,11 @@ sys_remove(const char* file) {
 }
 
 static int 
-sys_open(const char* file) {
+sys_open(const char* file, int flags) {
   check_valid_ptr(file);
   int res = -1;
+  if (flags & ~(O_DIRECT | O_COMPRESS)) // unknown flag
+    return -1;
   struct file_descriptor* file_desc = palloc_get_page(0);
   
   if (file_desc == NULL) // not enough space
@@ -406,9 +511,17 @@ sys_open(const char* file) {
   }
   // set file_descriptor
   file_desc->file = File;
+  if (flags & O_DIRECT)
+    file_set_direct(File, true);
 
   //judge whether a directory
   struct inode *inode = file_get_inode(file_desc->file);
+  if ((flags & O_COMPRESS) && !inode_set_compressed(inode)) {
+    file_close (File);
+    palloc_free_page (file_desc);
+    res = -1;
+    goto done;
+  }
   if (inode != NULL && inode_dir(inode)) 
     file_desc -> dir = dir_open(inode_reopen(inode));
   else 
@@ -476,6 +589,50 @@ sys_read(int fd, void *buffer, unsigned size) {
   return res;
 }
 
+/* Like sys_read, at OFFSET, leaving the file position alone */
+static int
+sys_pread(int fd, void *buffer, unsigned size, unsigned offset) {
+  check_valid_ptr(buffer);
+  check_valid_ptr(buffer + size - 1);
+  lock_acquire(&fileSys_lock);
+
+  int res = -1;
+  struct file_descriptor* fileD = get_file_descriptor(thread_current(), fd, 1);
+  if (fileD != NULL && fileD->file != NULL && (off_t) offset >= 0) {
+#ifdef VM
+    preload_pin_pages(buffer, size);
+#endif
+    res = file_read_at(fileD->file, buffer, size, offset);
+#ifdef VM
+    preload_unpin_pages(buffer, size);
+#endif
+  }
+  lock_release(&fileSys_lock);
+  return res;
+}
+
+/* Like sys_write, at OFFSET, leaving the file position alone */
+static int
+sys_pwrite(int fd, const void *buffer, unsigned size, unsigned offset) {
+  check_valid_ptr((const uint8_t*) buffer);
+  check_valid_ptr((const uint8_t*) buffer + size - 1);
+  lock_acquire(&fileSys_lock);
+
+  int res = -1;
+  struct file_descriptor* fileD = get_file_descriptor(thread_current(), fd, 1);
+  if (fileD != NULL && fileD->file != NULL && (off_t) offset >= 0) {
+#ifdef VM
+    preload_pin_pages(buffer, size);
+#endif
+    res = file_write_at(fileD->file, buffer, size, offset);
+#ifdef VM
+    preload_unpin_pages(buffer, size);
+#endif
+  }
+  lock_release(&fileSys_lock);
+  return res;
+}
+
 static void 
 sys_seek(int fd, unsigned position) {
   lock_acquire(&fileSys_lock);
@@ -625,8 +782,7 @@ mmapid_t sys_mmap(int fd, void *usr_page){
     for(size_t offset=0; offset < file_size; offset+=PGSIZE){
         void *addr = usr_page + offset;
         size_t read_bytes = (offset + PGSIZE < file_size ? PGSIZE : file_size - offset);
-        size_t zero_bytes = PGSIZE - read_bytes;
-        vm_supt_install_filesys(cur_thread->supt, addr, file, offset, read_bytes, zero_bytes, true);
+        vm_supt_install_mmap(cur_thread->supt, addr, file, offset, read_bytes);
     }
 
     mmapid_t mid;
@@ -692,32 +848,19 @@ bool sys_chdir(const char *name)
 
 bool sys_mkdir(const char *name) 
 {
-  //printf("makedir!\n");
-  lock_acquire(&fileSys_lock);
-  int len = strlen(name);
-  if (len == 0) 
-  {
-    lock_release(&fileSys_lock);
-    return false;
-  }
-  char directory[len], filename[len];
-  parse_path_name(name, directory, filename);
-  struct dir *dir = dir_open_path(directory);
+  char filename[NAME_MAX + 1];
   block_sector_t inode_sector = 0;
-  bool t2 = free_map_allocate (1, &inode_sector);
-  bool t3 = inode_create (inode_sector, 0, 1);
-  bool t4 = dir_add (dir, filename, inode_sector, 1);
- // printf("---name:   %s\n", name);
- // printf("---directory:   %s\n", directory);
- // printf("---filename:   %s\n", filename);
-  //printf("-----%d %d %d-----\n", t2 ,t3, t4);
+  lock_acquire(&fileSys_lock);
+  journal_begin();
+  struct dir *dir = dir_open_parent(name, filename);
   bool success = (dir != NULL
-                  && t2
-                  && t3
-                  && t4);
+                  && free_map_allocate (1, &inode_sector)
+                  && inode_create (inode_sector, 0, 1)
+                  && dir_add (dir, filename, inode_sector, 1));
   if (!success && inode_sector != 0)
     free_map_release(inode_sector, 1);
   dir_close(dir);
+  journal_end();
   lock_release(&fileSys_lock);
   return success;
 }
@@ -779,4 +922,96 @@ int sys_inumber(int fd)
   return ret;
 }
 
+int sys_getdents(int fd, struct dirent *entries, unsigned cnt)
+{
+  if (cnt == 0)
+    return 0;
+  /* A larger CNT would wrap the end of the array around. */
+  if (cnt > UINT_MAX / sizeof *entries)
+    return -1;
+  check_valid_ptr((const uint8_t*) entries);
+  if (cnt > ((uint8_t*) PHYS_BASE - (uint8_t*) entries) / sizeof *entries)
+    sys_exit(-1);
+  check_valid_ptr((const uint8_t*) (entries + cnt) - 1);
+  lock_acquire(&fileSys_lock);
+  struct file_descriptor* fdr = get_file_descriptor(thread_current(), fd, 2);
+  if (fdr == NULL)
+  {
+    lock_release(&fileSys_lock);
+    return -1;
+  }
+#ifdef VM
+  preload_pin_pages(entries, cnt * sizeof *entries);
+#endif
+  int res = dir_readdir_many(fdr->dir, entries, cnt);
+#ifdef VM
+  preload_unpin_pages(entries, cnt * sizeof *entries);
+#endif
+  lock_release(&fileSys_lock);
+  return res;
+}
+
+bool sys_fsync(int fd)
+{
+  lock_acquire(&fileSys_lock);
+  struct file_descriptor* fdr = get_file_descriptor(thread_current(), fd, 0);
+  bool res = fdr != NULL && fdr->file != NULL;
+  if (res)
+    file_sync(fdr->file);
+  lock_release(&fileSys_lock);
+  return res;
+}
+
+void sys_sync(void)
+{
+  lock_acquire(&fileSys_lock);
+  filesys_sync();
+  lock_release(&fileSys_lock);
+}
+
+bool sys_defrag(int fd)
+{
+  lock_acquire(&fileSys_lock);
+  struct file_descriptor* fdr = get_file_descriptor(thread_current(), fd, 1);
+  bool res = fdr != NULL && fdr->file != NULL && file_defragment(fdr->file);
+  lock_release(&fileSys_lock);
+  return res;
+}
+
+int sys_copy_file_range(int in_fd, int out_fd, unsigned size)
+{
+  lock_acquire(&fileSys_lock);
+  struct file_descriptor* in = get_file_descriptor(thread_current(), in_fd, 1);
+  struct file_descriptor* out = get_file_descriptor(thread_current(), out_fd, 1);
+  int res = -1;
+  /* file_copy() cannot copy between overlapping ranges of one
+     inode, so copying a file onto itself is refused. */
+  if (in != NULL && in->file != NULL && out != NULL && out->file != NULL
+      && file_get_inode(in->file) != file_get_inode(out->file))
+    res = file_copy(out->file, in->file, size);
+  lock_release(&fileSys_lock);
+  return res;
+}
+
+bool sys_blockstat(const char *device, struct block_stats *stats)
+{
+  check_valid_ptr((const uint8_t*) device);
+  check_valid_ptr((const uint8_t*) stats);
+  check_valid_ptr((const uint8_t*) stats + sizeof *stats - 1);
+
+  /* DEVICE names a device, such as "hda2", or a role, such as
+     "swap". */
+  struct block *block = block_get_by_name(device);
+  for (int i = 0; block == NULL && i < BLOCK_ROLE_CNT; i++)
+    if (!strcmp(device, block_type_name(i)))
+      block = block_get_role(i);
+  if (block == NULL)
+    return false;
+
+  struct block_stats s;
+  block_get_stats(block, &s);
+  memcpy(stats, &s, sizeof s);
+  return true;
+}
+
 #endif
@@ -1,9 +1,13 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 #include"userprog/process.h"
+#include "threads/synch.h"
 
 void syscall_init (void);
 
+/* Serializes all file system calls. */
+extern struct lock fileSys_lock;
+
 void sys_exit(int retVal);
 
 #ifdef VM
@@ -12,6 +12,7 @@
 #include "vm/page.h"
 #include "vm/frame.h"
 #include "filesys/file.h"
+#include "filesys/pagecache.h"
 
 static unsigned spte_hash_func(const struct hash_elem *elem, void *aux);
 static bool spte_less_func(const struct hash_elem *, const struct hash_elem*, void *aux);
@@ -82,12 +83,22 @@ bool vm_supt_install_filesys (struct supplemental_page_table *supt, void *page,
     spte->read_bytes = read_bytes;
     spte->zero_bytes = zero_bytes;
     spte->can_write = can_write;
+    spte->shared = false;
     struct hash_elem *prev_elem = hash_insert(&supt->page_hash, &spte->elem);
     if(prev_elem == NULL)
         return true;
     return false;
 }
 
+/* Like vm_supt_install_filesys, for a writable page of a memory-mapped file,
+   which is shared with other mappings through the page cache when possible*/
+bool vm_supt_install_mmap (struct supplemental_page_table *supt, void *page, struct file * file, off_t offset, uint32_t read_bytes){
+    if(!vm_supt_install_filesys(supt, page, file, offset, read_bytes, PGSIZE - read_bytes, true))
+        return false;
+    vm_supt_lookup(supt, page)->shared = true;
+    return true;
+}
+
 struct supplemental_page_table_entry* vm_supt_lookup (struct supplemental_page_table *supt, void *page){
     struct supplemental_page_table_entry spte;
     spte.usr_page = page;
@@ -121,11 +132,28 @@ static bool vm_load_page_from_filesys(struct supplemental_page_table_entry *spte
     return true;
 }
 
+/* Map the page cache's copy of a shared file page, instead of a private frame*/
+static bool vm_load_page_shared(struct supplemental_page_table_entry *spte, uint32_t *pagedir){
+    void *ker_page = pagecache_map(file_get_inode(spte->file), spte->file_offset / PGSIZE);
+    if(ker_page == NULL)
+        return false;
+    if(!pagedir_set_page(pagedir, spte->usr_page, ker_page, true)){
+        pagecache_unmap(ker_page);
+        return false;
+    }
+    spte->ker_page = ker_page;
+    spte->status = IN_PAGE_CACHE;
+    return true;
+}
+
 bool vm_load_page(struct supplemental_page_table *supt, uint32_t *pagedir, void *usr_page){
     struct supplemental_page_table_entry *spte = vm_supt_lookup(supt, usr_page);
     if(spte == NULL)
         return false;
-    if(spte->status == ON_FRAME)
+    if(spte->status == ON_FRAME || spte->status == IN_PAGE_CACHE)
+        return true;
+    /* Fall back to a private copy when the page cache is full*/
+    if(spte->status == FROM_FILESYS && spte->shared && vm_load_page_shared(spte, pagedir))
         return true;
 
     void *frame_page = vm_frame_allocate(PAL_USER, usr_page);
@@ -191,6 +219,14 @@ bool vm_supt_mm_unmap(struct supplemental_page_table *supt, uint32_t *pagedir, v
             vm_frame_free(spte->ker_page);
             pagedir_clear_page(pagedir, spte->usr_page);
             break;
+        case IN_PAGE_CACHE:
+            /* The page is shared, so write it back from its kernel address
+               and leave it in the page cache*/
+            if(spte->dirty || pagedir_is_dirty(pagedir, spte->usr_page))
+                file_write_at(file, spte->ker_page, bytes, offset);
+            pagedir_clear_page(pagedir, spte->usr_page);
+            pagecache_unmap(spte->ker_page);
+            break;
         case FROM_FILESYS: break;
         default:
 		break;
@@ -202,7 +238,8 @@ bool vm_supt_mm_unmap(struct supplemental_page_table *supt, uint32_t *pagedir, v
 
 void vm_pin_page(struct supplemental_page_table *supt, void *page){
     struct supplemental_page_table_entry *spte = vm_supt_lookup(supt, page);
-    if(spte == NULL)
+    /* Page cache pages are never evicted while mapped*/
+    if(spte == NULL || spte->status == IN_PAGE_CACHE)
         return;
     vm_frame_pin(spte->ker_page);
 }
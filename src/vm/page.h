@@ -13,7 +13,8 @@ enum page_status{
     ALL_ZERO,
     ON_FRAME,
     ON_SWAP,
-    FROM_FILESYS
+    FROM_FILESYS,
+    IN_PAGE_CACHE   //mapped file page shared through the page cache
 };
 
 struct supplemental_page_table_entry{
@@ -30,6 +31,7 @@ struct supplemental_page_table_entry{
     uint32_t read_bytes;
     uint32_t zero_bytes;
     bool can_write;
+    bool shared;    //mmap page, load it from the page cache
 };
 
 struct supplemental_page_table{
@@ -42,6 +44,7 @@ bool vm_supt_install_frame (struct supplemental_page_table *supt, void *usr_page
 bool vm_supt_install_zeropage (struct supplemental_page_table *supt, void *);
 bool vm_supt_set_swap (struct supplemental_page_table *supt, void *, swap_idx_t);
 bool vm_supt_install_filesys (struct supplemental_page_table *supt, void *page, struct file * file, off_t offset, uint32_t read_bytes, uint32_t zero_bytes, bool can_write);
+bool vm_supt_install_mmap (struct supplemental_page_table *supt, void *page, struct file * file, off_t offset, uint32_t read_bytes);
 
 struct supplemental_page_table_entry* vm_supt_lookup (struct supplemental_page_table *supt, void *);
 bool vm_supt_has_entry (struct supplemental_page_table *, void *page);
@@ -18,17 +18,14 @@ void vm_swap_init () {
 
 swap_idx_t vm_swap_out (void *page) {
     size_t swap_idx = bitmap_scan (swap_avail, 0, 1, true);
-    for (size_t i = 0; i < SECTORS_PER_PAGE; ++ i) {
-        block_write(swap_block, swap_idx * SECTORS_PER_PAGE + i, page + (BLOCK_SECTOR_SIZE * i));
-    }
+    /* Pages swapped out in a row usually land in adjacent slots. */
+    block_write_combine(swap_block, swap_idx * SECTORS_PER_PAGE, SECTORS_PER_PAGE, page);
     bitmap_set(swap_avail, swap_idx, false);
     return swap_idx;
 }
 
 void vm_swap_in (swap_idx_t swap_idx, void *page){
-    for (size_t i = 0; i < SECTORS_PER_PAGE; ++ i) {
-        block_read (swap_block, swap_idx * SECTORS_PER_PAGE + i, page + (BLOCK_SECTOR_SIZE * i));
-    }
+    block_read_multiple (swap_block, swap_idx * SECTORS_PER_PAGE, SECTORS_PER_PAGE, page);
     bitmap_set(swap_avail, swap_idx, true);
 }
 